@@ -20,5 +20,5 @@ void (*const volatile __vectors[])(void) __attribute__ ((section(".vectors"))) =
     __default_handler,  // Debug monitor handler
     0,                  // Reserved
     __default_handler,  // The PendSV handler
-    __default_handler   // The SysTick handler
+    __systick_handler   // The SysTick handler
 };
\ No newline at end of file
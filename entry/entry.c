@@ -7,6 +7,123 @@ typedef void (*entry_constructor)(void);
 // declaration to the main function
 int main();
 
+/**
+ * @brief Location of a packed range of the loader. Filled in by 
+ * tools/pack.py when the loader is packed. A size of 0 means the range is
+ * not packed
+ * 
+ */
+struct unpack_range {
+    // address to unpack the range to
+    uint32_t destination;
+
+    // address of the packed range
+    uint32_t source;
+
+    // size of the packed range
+    uint32_t size;
+};
+
+/**
+ * @brief Packed ranges of the loader. PrgData is never packed so the 
+ * sections before and after it are packed separately
+ * 
+ */
+struct unpack_header {
+    struct unpack_range ranges[2];
+};
+
+// volatile so the compiler does not use the values from the build. Not
+// const as the sizes are cleared after the loader is unpacked. The 
+// section is downloaded with the loader so every session starts packed
+volatile struct unpack_header __unpack_header __attribute__((section(".unpack"), __used__)) = {
+    {{0, 0, 0}, {0, 0, 0}}
+};
+
+/**
+ * @brief Unpack a lz4 block. Placed in the entry section as the code in
+ * the text section is not there yet when this is called
+ * 
+ * @details the loop distribution is disabled to prevent the compiler 
+ * from replacing the copy loops with calls to memcpy
+ * 
+ * @param destination 
+ * @param source 
+ * @param size size of the lz4 block
+ */
+static void __attribute__((section(".entry"), optimize("no-tree-loop-distribute-patterns"))) __unpack(
+    uint8_t *destination, const uint8_t *source, const uint32_t size) 
+{
+    const uint8_t *const end = source + size;
+
+    while (source < end) {
+        const uint8_t token = *source++;
+
+        // get the amount of literals
+        uint32_t length = token >> 4;
+
+        if (length == 15) {
+            uint8_t value;
+
+            do {
+                value = *source++;
+                length += value;
+            } while (value == 255);
+        }
+
+        // copy the literals
+        for (uint32_t i = 0; i < length; i++) {
+            *destination++ = *source++;
+        }
+
+        // the last sequence only has literals
+        if (source >= end) {
+            break;
+        }
+
+        // get the offset and the length of the match
+        const uint8_t *match = destination - (source[0] | (source[1] << 8));
+        source += 2;
+
+        length = token & 0xf;
+
+        if (length == 15) {
+            uint8_t value;
+
+            do {
+                value = *source++;
+                length += value;
+            } while (value == 255);
+        }
+
+        // copy the match. Byte by byte as the match can overlap the
+        // destination
+        for (uint32_t i = 0; i < (length + 4); i++) {
+            *destination++ = *match++;
+        }
+    }
+}
+
+/**
+ * @brief Unpack the loader when it is packed and was not unpacked yet. 
+ * The packed data is at the start of the heap and is overwritten by the
+ * loader buffers after this, so it is only unpacked once per download
+ * 
+ */
+void __attribute__((section(".entry"))) __unpack_loader() {
+    for (uint32_t i = 0; i < (sizeof(__unpack_header.ranges) / sizeof(__unpack_header.ranges[0])); i++) {
+        volatile struct unpack_range *const range = &__unpack_header.ranges[i];
+
+        if (!range->size) {
+            continue;
+        }
+
+        __unpack((uint8_t*)range->destination, (const uint8_t*)range->source, range->size);
+
+        range->size = 0;
+    }
+}
+
 /**
  * @brief Reset handler when the target starts running. This function
  * initilizes the bss and data segements
@@ -14,18 +131,25 @@ int main();
  * @details declares all linker variables as extern. Then we refer to the
  * value using the &operator as the variables is at a valid data address.
  * 
+ * When the loader is packed the rest of the loader is unpacked first.
+ * The reset handler is placed in the entry section so it is not packed.
+ * 
  * Functions that need to be called before main are run should have the
  * attribute "__constructor__". When marked the function will be added to
  * the ".init_array" segment and called before main is called.
  * 
  */
-void __attribute__((__noreturn__, __naked__)) __reset_handler() {
+void __attribute__((__noreturn__, __naked__, section(".entry"))) __reset_handler() {
     // initialize the stack pointer. As we are running from ram
     // the stack pointer is not setup yet. Move it to the stack
     // end segment to prevent a hardfault
     extern uint32_t __stack_end;
     asm volatile ("mov sp, %0" : : "r" (&__stack_end) : );
 
+    // unpack the loader if it is packed. This needs to be done before 
+    // anything in the text or data segments is used
+    __unpack_loader();
+
     extern uint8_t __bss_start;
     extern uint8_t __bss_end;
 
@@ -79,5 +203,8 @@ void __default_handler() {
     while (true) {}
 }
 
+// SysTick handler. Can be overridden by the application
+void __systick_handler() __attribute__((weak, alias("__default_handler")));
+
 // called when a vft entry is not yet filled in
 void __cxa_pure_virtual() {}
\ No newline at end of file
@@ -21,6 +21,12 @@ extern "C" {
     // address points to the correct location of the variable
     extern const uint32_t __heap_end;
 
+    // pointer to the start and end of the ahb sram the loader can use. 
+    // Definition is done in the linkerscript. Both are the same when the
+    // loader does not use the ahb sram
+    extern const uint32_t __ahb_start;
+    extern const uint32_t __ahb_end;
+
     /**
      * @brief Generic reset handler that initializes the .bss and .data
      * segments. It calls all the constructors and runs main. When code
@@ -30,12 +36,27 @@ extern "C" {
      */
     void __reset_handler();
 
+    /**
+     * @brief Unpack the loader when it is packed. Does nothing when the
+     * loader is not packed or was unpacked already. Placed in the entry
+     * section so it can run before the rest of the loader is there
+     * 
+     */
+    void __unpack_loader();
+
     /**
      * @brief Default handler. Should be used to initialize the default
      * arm vector table. 
      * 
      */
     void __default_handler();
+
+    /**
+     * @brief SysTick handler. Uses the default handler when it is not 
+     * implemented
+     * 
+     */
+    void __systick_handler();
 }
 
 #endif
\ No newline at end of file
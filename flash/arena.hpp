@@ -0,0 +1,106 @@
+#ifndef FLASH_ARENA_HPP
+#define FLASH_ARENA_HPP
+
+#include <cstdint>
+
+#include "../entry/entry.hpp"
+
+/**
+ * @brief Bump allocator over a memory region. Everything is allocated 
+ * during Init and released at once with a reset. There is no way to 
+ * free a single allocation.
+ * 
+ * @tparam Start linker symbol at the start of the region
+ * @tparam End linker symbol at the end of the region
+ */
+template <const uint32_t& Start, const uint32_t& End>
+class region_arena {
+protected:
+    // current position in the region. 0 when the arena is not 
+    // initialized yet
+    static inline uint32_t current = 0;
+
+    /**
+     * @brief Get the end of the region
+     * 
+     * @return uint32_t 
+     */
+    static uint32_t end() {
+        return reinterpret_cast<uint32_t>(&End);
+    }
+
+    /**
+     * @brief Align a address to the alignment. Alignment should be 
+     * a power of 2
+     * 
+     * @param address 
+     * @param alignment 
+     * @return uint32_t 
+     */
+    constexpr static uint32_t align(const uint32_t address, const uint32_t alignment) {
+        return (address + (alignment - 1)) & ~(alignment - 1);
+    }
+
+public:
+    /**
+     * @brief Release all the allocations and start at the 
+     * beginning of the region again
+     * 
+     */
+    static void reset() {
+        current = reinterpret_cast<uint32_t>(&Start);
+    }
+
+    /**
+     * @brief Returns the amount of bytes that can still be allocated
+     * with the alignment
+     * 
+     * @param alignment 
+     * @return uint32_t 
+     */
+    static uint32_t available(const uint32_t alignment = 4) {
+        const uint32_t start = align(current, alignment);
+
+        // check if we have anything left
+        if (start >= end()) {
+            return 0;
+        }
+
+        return end() - start;
+    }
+
+    /**
+     * @brief Allocate a amount of items from the region
+     * 
+     * @tparam T 
+     * @param count amount of items to allocate
+     * @param alignment alignment of the first item
+     * @return T* nullptr when there is not enough space left
+     */
+    template <typename T = uint8_t>
+    static T* allocate(const uint32_t count, const uint32_t alignment = alignof(T)) {
+        const uint32_t size = count * sizeof(T);
+
+        // check if we have enough space
+        if (available(alignment) < size) {
+            return nullptr;
+        }
+
+        // get the aligned start of the allocation
+        const uint32_t start = align(current, alignment);
+
+        // move past the allocation
+        current = start + size;
+
+        return reinterpret_cast<T*>(start);
+    }
+};
+
+// arena over the heap region (the ram left after the stack)
+using arena = region_arena<__heap_start, __heap_end>;
+
+// arena over the ahb sram. Empty when the ahb arena is disabled in cmake
+// or the part has no ahb sram
+using ahb_arena = region_arena<__ahb_start, __ahb_end>;
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef FLASH_CHIPS_HPP
+#define FLASH_CHIPS_HPP
+
+#include <cstdint>
+
+#include "timing.hpp"
+
+namespace chips {
+    /**
+     * @brief Geometry, timings and commands of a single spi nor part
+     * 
+     */
+    struct part {
+        // jedec id of the part. Manufacturer id in the upper byte
+        uint32_t id;
+
+        // size of the device in bytes. 0 uses the capacity byte of the
+        // jedec id
+        uint32_t size;
+
+        // size of a page
+        uint32_t page_size;
+
+        // opcodes of the erase units. 0 when the part does not support 
+        // the unit
+        uint8_t sector_erase;
+        uint8_t block_erase_32k;
+        uint8_t block_erase_64k;
+
+        // flag if the part supports fast read (0x0b) with a dummy byte
+        bool fast_read;
+
+        // flag if the part supports quad input page program (0x32) with
+        // the quad enable bit in bit 6 of the status register
+        bool quad_program;
+
+        // maximum spi clock of read (0x03) and fast read (0x0b) in hz
+        uint32_t read_clock;
+        uint32_t fast_read_clock;
+
+        // busy times of the part
+        timing::device timing;
+    };
+
+    /**
+     * @brief All the parts the loader knows. The first part is the part
+     * the loader was written for
+     * 
+     */
+    constexpr static part table[] = {
+        {
+            .id = 0x9d4013, .size = 0x80000, .page_size = 256,
+            .sector_erase = 0xd7, .block_erase_32k = 0x52, .block_erase_64k = 0xd8,
+            .fast_read = true, .quad_program = true,
+            .read_clock = 33'000'000, .fast_read_clock = 104'000'000,
+            .timing = timing::is25lq040b,
+        },
+        {
+            .id = 0xef4013, .size = 0x80000, .page_size = 256,
+            .sector_erase = 0x20, .block_erase_32k = 0x52, .block_erase_64k = 0xd8,
+            .fast_read = true, .quad_program = false,
+            .read_clock = 50'000'000, .fast_read_clock = 104'000'000,
+            .timing = timing::w25q40cl,
+        },
+        {
+            .id = 0xc84013, .size = 0x80000, .page_size = 256,
+            .sector_erase = 0x20, .block_erase_32k = 0x52, .block_erase_64k = 0xd8,
+            .fast_read = true, .quad_program = false,
+            .read_clock = 80'000'000, .fast_read_clock = 120'000'000,
+            .timing = timing::gd25q40c,
+        },
+        {
+            .id = 0xc22013, .size = 0x80000, .page_size = 256,
+            .sector_erase = 0x20, .block_erase_32k = 0x00, .block_erase_64k = 0xd8,
+            .fast_read = true, .quad_program = false,
+            .read_clock = 33'000'000, .fast_read_clock = 86'000'000,
+            .timing = timing::mx25l4006e,
+        },
+    };
+
+    /**
+     * @brief Get the slowest of two operations
+     * 
+     * @param a
+     * @param b
+     * @return timing::operation
+     */
+    constexpr static timing::operation slowest(const timing::operation& a, const timing::operation& b) {
+        return {
+            (a.typical > b.typical) ? a.typical : b.typical,
+            (a.maximum > b.maximum) ? a.maximum : b.maximum
+        };
+    }
+
+    /**
+     * @brief Create the part used for a device that is not in the table.
+     * Only uses the commands every part supports with the slowest timings
+     * of the table
+     * 
+     * @return part
+     */
+    constexpr static part conservative() {
+        part result = {
+            .id = 0, .size = 0, .page_size = 256,
+            .sector_erase = 0x20, .block_erase_32k = 0x52, .block_erase_64k = 0xd8,
+            .fast_read = true, .quad_program = false,
+            .read_clock = 0xffffffff, .fast_read_clock = 0xffffffff,
+            .timing = {},
+        };
+
+        for (const part& p: table) {
+            result.block_erase_32k = p.block_erase_32k ? result.block_erase_32k : 0x00;
+            result.fast_read &= p.fast_read;
+            result.read_clock = (p.read_clock < result.read_clock) ? p.read_clock : result.read_clock;
+            result.fast_read_clock = (p.fast_read_clock < result.fast_read_clock) ? p.fast_read_clock : result.fast_read_clock;
+
+            timing::device& t = result.timing;
+
+            t.page_program = slowest(t.page_program, p.timing.page_program);
+            t.sector_erase = slowest(t.sector_erase, p.timing.sector_erase);
+            t.block_erase_32k = slowest(t.block_erase_32k, p.timing.block_erase_32k);
+            t.block_erase_64k = slowest(t.block_erase_64k, p.timing.block_erase_64k);
+            t.chip_erase = slowest(t.chip_erase, p.timing.chip_erase);
+            t.write_status = slowest(t.write_status, p.timing.write_status);
+            t.power_up = slowest(t.power_up, p.timing.power_up);
+            t.release_power_down = slowest(t.release_power_down, p.timing.release_power_down);
+            t.cs_high = (p.timing.cs_high > t.cs_high) ? p.timing.cs_high : t.cs_high;
+            t.cs_hold = (p.timing.cs_hold > t.cs_hold) ? p.timing.cs_hold : t.cs_hold;
+        }
+
+        return result;
+    }
+
+    // part for devices that are not in the table. Has the worst case
+    // timings so it can be used before the device is known
+    constexpr static part unknown = conservative();
+
+    /**
+     * @brief Find the part with a jedec id
+     * 
+     * @param id
+     * @return const part& the unknown part when the id is not in the table
+     */
+    constexpr static const part& find(const uint32_t id) {
+        for (const part& p: table) {
+            if (p.id == id) {
+                return p;
+            }
+        }
+
+        return unknown;
+    }
+
+    // the runtime sector layout and the sampled erase verify depend on
+    // these erase units
+    static_assert(
+        unknown.sector_erase && unknown.block_erase_64k, 
+        "Every part should support a sector and a 64k block erase"
+    );
+}
+
+#endif
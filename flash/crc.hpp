@@ -0,0 +1,62 @@
+#ifndef FLASH_CRC_HPP
+#define FLASH_CRC_HPP
+
+#include <cstdint>
+
+/**
+ * @brief Incremental reflected crc-32 with a runtime polynomial. Uses a
+ * table of 16 entries and processes a nibble per lookup so the table can
+ * be created for every call. Does not invert the input or the output,
+ * the caller passes the start value and finishes the crc.
+ * 
+ */
+class crc32 {
+protected:
+    // crc of every nibble
+    uint32_t table[16];
+
+    // current crc
+    uint32_t value;
+
+public:
+    /**
+     * @brief Create the table for a polynomial
+     * 
+     * @param polynomial reflected polynomial (0xedb88320 for crc-32)
+     * @param initial start value of the crc
+     */
+    crc32(const uint32_t polynomial, const uint32_t initial):
+        value(initial)
+    {
+        for (uint32_t i = 0; i < 16; i++) {
+            uint32_t c = i;
+
+            for (uint32_t bit = 0; bit < 4; bit++) {
+                c = (c & 0x1) ? ((c >> 1) ^ polynomial) : (c >> 1);
+            }
+
+            table[i] = c;
+        }
+    }
+
+    /**
+     * @brief Add a byte to the crc. The low nibble goes first
+     * 
+     * @param data
+     */
+    void update(const uint8_t data) {
+        value = (value >> 4) ^ table[(value ^ data) & 0xf];
+        value = (value >> 4) ^ table[(value ^ (data >> 4)) & 0xf];
+    }
+
+    /**
+     * @brief Get the current crc
+     * 
+     * @return uint32_t
+     */
+    uint32_t get() const {
+        return value;
+    }
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef FLASH_CYCLES_HPP
+#define FLASH_CYCLES_HPP
+
+#include <cstdint>
+
+/**
+ * @brief Cycle counter of the cortex-m3 data watchpoint and trace unit. 
+ * Counts cpu clocks and wraps around every 2^32 cycles.
+ * 
+ */
+class cycles {
+protected:
+    // debug exception and monitor control register
+    static inline volatile uint32_t *const demcr = reinterpret_cast<volatile uint32_t*>(0xe000edfc);
+
+    // dwt control register
+    static inline volatile uint32_t *const control = reinterpret_cast<volatile uint32_t*>(0xe0001000);
+
+    // dwt cycle count register
+    static inline volatile uint32_t *const count = reinterpret_cast<volatile uint32_t*>(0xe0001004);
+
+public:
+    /**
+     * @brief Enable the cycle counter
+     * 
+     */
+    static void init() {
+        // enable the trace unit (TRCENA)
+        (*demcr) |= (0x1 << 24);
+
+        // enable the cycle counter (CYCCNTENA)
+        (*control) |= 0x1;
+    }
+
+    /**
+     * @brief Get the current cycle count
+     * 
+     * @return uint32_t 
+     */
+    static uint32_t get() {
+        return (*count);
+    }
+};
+
+#endif
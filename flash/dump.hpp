@@ -0,0 +1,201 @@
+#ifndef FLASH_DUMP_HPP
+#define FLASH_DUMP_HPP
+
+#include <cstdint>
+
+/**
+ * @brief Compression for the readback dump. Every token starts with a
+ * byte with the type in the upper 2 bits:
+ * 
+ * literal: 00llllll + <l + 1> bytes
+ * erased:  01llllll llllllll. <l + 1> bytes of the erase value
+ * match:   10llllll oooooooo oooooooo. <l + 4> bytes from <o + 1> bytes back
+ * run:     11llllll llllllll vvvvvvvv. <l + 1> bytes of v
+ * 
+ * Offsets are little endian. Matches never go back past the start of
+ * the compressed chunk. tools/dump.py decompresses the stream.
+ * 
+ */
+namespace dump {
+    // token types
+    enum class token: uint8_t {
+        literal = 0x00,
+        erased = 0x40,
+        match = 0x80,
+        run = 0xc0,
+    };
+
+    // limits of the tokens
+    constexpr static uint32_t max_literals = 64;
+    constexpr static uint32_t max_run = 0x4000;
+    constexpr static uint32_t min_match = 4;
+    constexpr static uint32_t max_match = 64 + (min_match - 1);
+    constexpr static uint32_t max_offset = 0x10000;
+
+    // shortest runs that are smaller than the same data as literals
+    constexpr static uint32_t min_erased = 3;
+    constexpr static uint32_t min_run = 4;
+
+    // amount of entries in the match table. <Entries> = 2 ^ bits
+    constexpr static uint32_t table_bits = 9;
+    constexpr static uint32_t table_size = (0x1 << table_bits);
+
+    // largest chunk that can be compressed at once. The match table
+    // stores 16 bit positions
+    constexpr static uint32_t max_chunk = 0xffff;
+
+    /**
+     * @brief Largest output of a chunk. Data without runs or matches
+     * is stored as literals
+     * 
+     * @param size
+     * @return uint32_t
+     */
+    constexpr static uint32_t worst_case(const uint32_t size) {
+        return size + ((size + (max_literals - 1)) / max_literals);
+    }
+
+    /**
+     * @brief Greedy compressor. Checks for a run first and then for a
+     * match using the last position of every hashed 4 byte sequence.
+     * 
+     */
+    class compressor {
+    protected:
+        // output of the current chunk
+        uint8_t *out;
+
+        /**
+         * @brief Write literals in tokens of at most max_literals
+         * 
+         * @param data
+         * @param size
+         */
+        void literals(const uint8_t *data, uint32_t size) {
+            while (size) {
+                const uint32_t s = (size > max_literals) ? max_literals : size;
+
+                *out++ = static_cast<uint8_t>(token::literal) | (s - 1);
+
+                for (uint32_t i = 0; i < s; i++) {
+                    *out++ = data[i];
+                }
+
+                data += s;
+                size -= s;
+            }
+        }
+
+        /**
+         * @brief Hash of the 4 bytes at data
+         * 
+         * @param data
+         * @return uint32_t
+         */
+        static uint32_t hash(const uint8_t *const data) {
+            const uint32_t value = (
+                data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24)
+            );
+
+            return (value * 2654435761u) >> (32 - table_bits);
+        }
+
+    public:
+        /**
+         * @brief Compress a chunk. The output should have space for
+         * worst_case(size) bytes
+         * 
+         * @param data
+         * @param size at most max_chunk
+         * @param output
+         * @param table match table with table_size entries
+         * @param erase_value
+         * @return uint32_t amount of bytes written to the output
+         */
+        uint32_t compress(
+            const uint8_t *const data, const uint32_t size, uint8_t *const output,
+            uint16_t *const table, const uint8_t erase_value)
+        {
+            out = output;
+
+            // positions in the table are stored + 1 so 0 is empty
+            for (uint32_t i = 0; i < table_size; i++) {
+                table[i] = 0;
+            }
+
+            uint32_t anchor = 0;
+            uint32_t i = 0;
+
+            while (i < size) {
+                // check for a run of the same byte
+                uint32_t length = 1;
+
+                while ((i + length) < size && length < max_run && data[i + length] == data[i]) {
+                    length++;
+                }
+
+                const bool erased = (data[i] == erase_value);
+
+                if (length >= (erased ? min_erased : min_run)) {
+                    literals(data + anchor, i - anchor);
+
+                    *out++ = (
+                        static_cast<uint8_t>(erased ? token::erased : token::run) |
+                        ((length - 1) >> 8)
+                    );
+                    *out++ = static_cast<uint8_t>(length - 1);
+
+                    if (!erased) {
+                        *out++ = data[i];
+                    }
+
+                    i += length;
+                    anchor = i;
+
+                    continue;
+                }
+
+                // check for a match
+                if ((i + min_match) <= size) {
+                    const uint32_t h = hash(data + i);
+                    const uint32_t candidate = table[h];
+
+                    table[h] = i + 1;
+
+                    if (candidate && (i - (candidate - 1)) <= max_offset) {
+                        const uint8_t *const match = data + (candidate - 1);
+
+                        length = 0;
+
+                        while ((i + length) < size && length < max_match && match[length] == data[i + length]) {
+                            length++;
+                        }
+
+                        if (length >= min_match) {
+                            literals(data + anchor, i - anchor);
+
+                            const uint32_t offset = (i - (candidate - 1)) - 1;
+
+                            *out++ = static_cast<uint8_t>(token::match) | (length - min_match);
+                            *out++ = static_cast<uint8_t>(offset);
+                            *out++ = static_cast<uint8_t>(offset >> 8);
+
+                            i += length;
+                            anchor = i;
+
+                            continue;
+                        }
+                    }
+                }
+
+                i++;
+            }
+
+            literals(data + anchor, i - anchor);
+
+            return out - output;
+        }
+    };
+}
+
+#endif
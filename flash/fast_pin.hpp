@@ -0,0 +1,101 @@
+#ifndef FLASH_FAST_PIN_HPP
+#define FLASH_FAST_PIN_HPP
+
+#include <cstdint>
+
+#include <io/pins.hpp>
+
+#include "cycles.hpp"
+
+/**
+ * @brief Output pin that writes the lpc17xx FIOSET/FIOCLR registers 
+ * directly using a precomputed mask. Enforces a minimum hold time 
+ * before a rising edge and a minimum high time between a rising and the 
+ * next falling edge using the cycle counter. Made for chip selects that 
+ * toggle multiple times per page.
+ * 
+ * @warning the writes are ignored when the pin is masked in FIOMASK
+ * 
+ * @tparam Pin 
+ * @tparam MinHighCycles minimum amount of cpu cycles the pin stays high
+ * @tparam MinHoldCycles minimum amount of cpu cycles the pin stays low 
+ * after set<true> is called. The spi driver returns after the last clock
+ * so this is the hold time after the last clock
+ */
+template <typename Pin, uint32_t MinHighCycles, uint32_t MinHoldCycles = 0>
+class fast_pin_out {
+protected:
+    // base address of the fast gpio port of the pin
+    constexpr static uint32_t base = 0x2009c000 + (Pin::port::id * 0x20);
+
+    // mask of the pin in the port registers
+    constexpr static uint32_t mask = (0x1u << Pin::number);
+
+    // port set register
+    static inline volatile uint32_t *const fioset = reinterpret_cast<volatile uint32_t*>(base + 0x18);
+
+    // port clear register
+    static inline volatile uint32_t *const fioclr = reinterpret_cast<volatile uint32_t*>(base + 0x1c);
+
+    // cycle count of the last rising edge
+    static inline uint32_t released = 0;
+
+public:
+    /**
+     * @brief Init the pin using the generic pin implementation
+     * 
+     */
+    static void init() {
+        klib::target::io::pin_out<Pin>::init();
+
+        // make sure the first falling edge does not wait
+        released = cycles::get() - MinHighCycles;
+    }
+
+    /**
+     * @brief Set the pin to a value
+     * 
+     * @tparam Value 
+     */
+    template <bool Value>
+    static void set() {
+        if constexpr (Value) {
+            // keep the pin low for the hold time after the last clock
+            if constexpr (MinHoldCycles > 0) {
+                const uint32_t start = cycles::get();
+
+                while ((cycles::get() - start) < MinHoldCycles) {
+                    // wait
+                }
+            }
+
+            (*fioset) = mask;
+            released = cycles::get();
+        }
+        else {
+            // make sure the pin was high long enough. Most of the time
+            // this is already the case
+            while ((cycles::get() - released) < MinHighCycles) {
+                // wait
+            }
+
+            (*fioclr) = mask;
+        }
+    }
+
+    /**
+     * @brief Set the pin to a value
+     * 
+     * @param value 
+     */
+    static void set(const bool value) {
+        if (value) {
+            set<true>();
+        }
+        else {
+            set<false>();
+        }
+    }
+};
+
+#endif
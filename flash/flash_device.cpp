@@ -1,19 +1,21 @@
 #include <cstdint>
 #include "flash_os.hpp"
+#include "arena.hpp"
+#include "timing.hpp"
+#include "cycles.hpp"
+#include "progress.hpp"
+#include "trace.hpp"
+#include "profile.hpp"
+#include "geometry.hpp"
+#include "sha256.hpp"
+#include "crc.hpp"
+#include "dump.hpp"
+#include "hardware.hpp"
 
 #include <klib/klib.hpp>
-#include <io/pins.hpp>
-#include <io/spi.hpp>
 #include <io/system.hpp>
 
 #include <klib/delay.hpp>
-#include <klib/hardware/memory/is25lq040b.hpp>
-
-namespace target = klib::target;
-
-using cs = target::io::pin_out<target::pins::package::lqfp_80::p50>;
-using spi = target::io::spi<target::io::periph::lqfp_80::spi0>;
-using memory = klib::hardware::memory::is25lq040b<spi, cs>;
 
 /**
  * @brief Smallest amount of data that can be programmed
@@ -46,18 +48,19 @@ using memory = klib::hardware::memory::is25lq040b<spi, cs>;
 #define UNIFORM_SECTORS (true)
 
 /**
- * @brief Sector size shift for when using uniform sector erase
- * 
- * <SectorSize> = 2 ^ Shift. Shift = 12 => <SectorSize> = 2 ^ 12 = 4096 bytes
+ * @brief Use a custom verify. Is optional. Speeds up verifying. Compares 
+ * the data as it is received from the device without a read buffer
  * 
  */
-#define SECTOR_SIZE_SHIFT (12)
+#define CUSTOM_VERIFY (false)
 
 /**
- * @brief Use a custom verify. Is optional. Speeds up verifying
+ * @brief Calculate the crc J-Link uses to compare the flash with the data
+ * to program on the loader. The crc is updated as the data is received 
+ * from the device without a read buffer
  * 
  */
-#define CUSTOM_VERIFY (false)
+#define CALC_CRC (false)
 
 /**
  * @brief Enable changes to the sector layout at runtime. Can be used to create
@@ -67,6 +70,129 @@ using memory = klib::hardware::memory::is25lq040b<spi, cs>;
  */
 #define RUNTIME_SECTORS (false)
 
+/**
+ * @brief Size at the start of the device that uses the smallest erase unit
+ * when RUNTIME_SECTORS is enabled. The rest of the device uses the largest
+ * erase unit. Should be a multiple of the largest erase unit
+ * 
+ */
+#define RUNTIME_FINE_SIZE (0x10000)
+
+/**
+ * @brief Send the page data using quad input page program. Needs IO2 and 
+ * IO3 of the device connected to the gpio pins set in hardware.hpp. Sets
+ * the quad enable bit during the session
+ * 
+ */
+#define QUAD_PROGRAM (false)
+
+/**
+ * @brief Enable the sha-256 range digest extension. Allows the host to 
+ * check what is in flash without reading it back
+ * 
+ */
+#define HASH_RANGE (true)
+
+/**
+ * @brief Enable the dry-run estimate extension. Allows the host to 
+ * predict the time of a operation without changing the flash
+ * 
+ */
+#define ESTIMATE (true)
+
+/**
+ * @brief Enable the compressed readback extension. Allows the host to 
+ * backup the device while only reading the compressed data
+ * 
+ */
+#define DUMP (true)
+
+/**
+ * @brief Enable the non-blank extent extension. Allows the host to find 
+ * all the data on the device in a single call
+ * 
+ */
+#define EXTENTS (true)
+
+/**
+ * @brief Enable the batch program extension. Programs and checks the 
+ * critical regions of a image before the rest so a aborted session still 
+ * leaves a bootable device
+ * 
+ */
+#define PROGRAM_BATCH (true)
+
+/**
+ * @brief Blank check sectors the loader erased by reading a sample of the
+ * words. Falls back to reading the whole sector when a sample is not 
+ * blank. Only used for sectors that were not programmed after the erase
+ * 
+ */
+#define SAMPLED_ERASE_VERIFY (true)
+
+/**
+ * @brief Amount of pseudo-random words checked per sector next to the 
+ * first and last word of every page
+ * 
+ */
+#define ERASE_VERIFY_SAMPLES (8)
+
+/**
+ * @brief Skip the pages that only have the erase value when programming.
+ * A program only clears bits so the device does not change. A skipped 
+ * page is not marked in the erased bitmap of SAMPLED_ERASE_VERIFY, its 
+ * sector stays marked as erased when it was before. This is correct as 
+ * the page still only has the erase value
+ * 
+ */
+#define SKIP_ERASED_PAGES (false)
+
+/**
+ * @brief Record the start and end of every ramcode call and the bus 
+ * operations inside it in the LoaderTrace ring buffer. The ring gets
+ * half of the heap region that is left after the fixed buffers. Convert
+ * it with tools/timeline.py to see the timeline of a session
+ * 
+ */
+#define TRACE (false)
+
+/**
+ * @brief Sample the program counter with the SysTick interrupt during 
+ * every ramcode call. The samples are counted in the LoaderProfile 
+ * histogram. Map it to the functions with tools/hotspots.py
+ * 
+ */
+#define PROFILE (false)
+
+/**
+ * @brief Cpu cycles between two profiler samples
+ * 
+ */
+#define PROFILE_INTERVAL (9600)
+
+/**
+ * @brief Clock of the spi bus in hz. Init fails when the fitted part 
+ * can not read at this clock. Fast read is used when the clock is above
+ * the read clock of the part
+ * 
+ */
+#define SPI_FREQUENCY (1'000'000)
+
+/**
+ * @brief Longest interval in microseconds between status polls while 
+ * waiting for the device to finish a operation. Init shortens it to the 
+ * typical page program time of the fitted part
+ * 
+ */
+#define POLL_INTERVAL (3000)
+
+/**
+ * @brief Interval in microseconds between polls while waiting for the 
+ * device to answer during Init
+ * 
+ */
+#define READY_POLL_INTERVAL (10)
+
 
 /**
  * @brief Device specific infomation
@@ -77,6 +203,35 @@ extern "C" {
     // a wrong name in the symbol table
     extern const struct flash_device FlashDevice;
 
+    // progress record the host can read while the loader is running
+    volatile progress::record LoaderProgress __attribute__ ((section (".progress"), __used__));
+
+#if TRACE
+    // timeline of the session the host can read between the calls. In 
+    // the data section so it starts empty every download
+    volatile trace::buffer LoaderTrace __attribute__ ((section (".data"), __used__)) = {};
+#endif
+
+#if PROFILE
+    // program counter histogram the host can read between the calls
+    volatile profile::histogram LoaderProfile __attribute__ ((__used__));
+
+    // add a sample to the histogram. Called by the SysTick handler
+    void __attribute__ ((__used__)) __profile_sample(const uint32_t pc) {
+        profile::sample(pc);
+    }
+
+    // get the stacked program counter of the interrupted code. The
+    // loader always runs on the main stack
+    void __attribute__ ((naked)) __systick_handler() {
+        asm volatile (
+            "mrs r0, msp\n"
+            "ldr r0, [r0, #24]\n"
+            "b __profile_sample\n"
+        );
+    }
+#endif
+
     // Mark start of <PrgData> segment. Non-static to make sure linker can keep this 
     // symbol. Dummy needed to make sure that <PrgData> section in resulting ELF file 
     // is present. Needed by open flash loader logic on PC side
@@ -118,6 +273,12 @@ const flash_device FlashDevice __attribute__ ((section ("DevDscr"), __used__)) =
     #define VERIFY_FUNC nullptr
 #endif
 
+#if CALC_CRC
+    #define CALC_CRC_FUNC SEGGER_OPEN_CalcCRC
+#else 
+    #define CALC_CRC_FUNC nullptr
+#endif
+
 #if CHIP_ERASE
     #define CHIP_ERASE_FUNC EraseChip
 #else
@@ -136,224 +297,1731 @@ const flash_device FlashDevice __attribute__ ((section ("DevDscr"), __used__)) =
     #define RUNTIME_SECTORS_FUNC nullptr
 #endif
 
+// recorder for the trace events. Does nothing when TRACE is disabled
+using tracer = trace::recorder<TRACE>;
+
+// program counter sampler. Does nothing when PROFILE is disabled
+using profiler = profile::sampler<PROFILE, PROFILE_INTERVAL>;
+
 /**
- * @brief array with all the functions for the segger software
+ * @brief Progress, trace and profile of a ramcode call. Only the 
+ * outermost call runs the profiler
  * 
  */
-extern "C" {
-    // declaration for the OFL Api. If we initialize it here we get
-    // a wrong name in the symbol table
-    extern const uint32_t SEGGER_OFL_Api[];
-}
+class call_scope: public progress::scope {
+protected:
+    const tracer::scope trace;
 
-// definition of OFL Api
-const uint32_t SEGGER_OFL_Api[] __attribute__ ((section ("PrgCode"), __used__)) = {
-    reinterpret_cast<uint32_t>(FeedWatchdog),
-    reinterpret_cast<uint32_t>(Init),
-    reinterpret_cast<uint32_t>(UnInit),
-    reinterpret_cast<uint32_t>(EraseSector),
-    reinterpret_cast<uint32_t>(ProgramPage),
-    reinterpret_cast<uint32_t>(BLANK_CHECK_FUNC),
-    reinterpret_cast<uint32_t>(CHIP_ERASE_FUNC),
-    reinterpret_cast<uint32_t>(VERIFY_FUNC),
-    reinterpret_cast<uint32_t>(nullptr), // SEGGER_OPEN_CalcCRC
-    reinterpret_cast<uint32_t>(OPEN_READ_FUNC),
-    reinterpret_cast<uint32_t>(SEGGER_OPEN_Program),
-    reinterpret_cast<uint32_t>(UNIFORM_ERASE_FUNC),
-    reinterpret_cast<uint32_t>(nullptr), // SEGGER_OPEN_Start for turbo mode
-    reinterpret_cast<uint32_t>(RUNTIME_SECTORS_FUNC),
+public:
+    call_scope(const progress::operation op, const uint32_t total, const bool traced = true):
+        progress::scope(op, total), trace(trace::event::call, static_cast<uint8_t>(op), traced)
+    {
+        if (owner) {
+            profiler::start();
+        }
+    }
+
+    ~call_scope() {
+        if (owner) {
+            profiler::stop();
+        }
+    }
 };
 
-void __attribute__ ((noinline)) FeedWatchdog(void) {
-    // TODO: implement something to keep the watchdog happy
-    return;
-}
+#if SAMPLED_ERASE_VERIFY
+/**
+ * @brief Bitmap of the sectors the loader erased that were not programmed
+ * after. Kept between the ramcode calls so the blank check J-Link does 
+ * after a erase can use a sample of the sector
+ * 
+ */
+namespace erased {
+    // size of a tracked sector. <SectorSize> = 2 ^ Shift. Should be the 
+    // smallest erase unit
+    constexpr static uint32_t shift = 12;
+
+    // marker of a valid bitmap. The ram is not initialized when the
+    // loader is downloaded
+    constexpr static uint32_t valid = 0x45525344;
+
+    // set to valid when the bitmap is cleared. Placed in .data so every
+    // download sets it back. A bitmap left in ram by a earlier session 
+    // does not know what was written to the device since then
+    static uint32_t marker __attribute__ ((section (".data"))) = 0;
+
+    // bitmap with a bit for every sector
+    static uint32_t* bits = nullptr;
+
+    // amount of sectors in the bitmap
+    static uint32_t sectors = 0;
+
+    /**
+     * @brief Allocate the bitmap. Keeps the bits of a previous Init of 
+     * the same download as the bitmap is always at the same place in the
+     * heap region
+     * 
+     * @param size size of the device
+     * @return true when the bitmap could be allocated
+     */
+    static bool setup(const uint32_t size) {
+        const uint32_t count = (size >> shift);
+
+        bits = arena::allocate<uint32_t>((count + 31) / 32);
+
+        if (bits == nullptr) {
+            return false;
+        }
 
-int __attribute__ ((noinline)) Init(const uint32_t address, const uint32_t frequency, const uint32_t function) {
-    using clock = target::io::system::clock;
+        // clear the bitmap when it is not from this session
+        if (marker != valid || sectors != count) {
+            for (uint32_t i = 0; i < ((count + 31) / 32); i++) {
+                bits[i] = 0;
+            }
 
-    // setup the flash wait state to 4 + 1 CPU clocks
-    target::io::system::flash::setup<4>();
+            sectors = count;
+            marker = valid;
+        }
 
-    // setup the clock to 96Mhz (this is using the internal 4Mhz oscillator)
-    // (((47 + 1) * 2 * 4Mhz) / (0 + 1) = 384Mhz) / (3 + 1) = 96Mhz
-    clock::set_main<clock::source::internal, 4'000'000, 48, 1, 4>();
+        return true;
+    }
 
-    // init the cs pin
-    cs::init();
+    /**
+     * @brief Mark every sector that has a part of a range
+     * 
+     * @param offset 
+     * @param size 
+     * @param value true when the sectors are erased
+     */
+    static void mark(const uint32_t offset, const uint32_t size, const bool value) {
+        const uint32_t last = klib::min((offset + size + ((0x1 << shift) - 1)) >> shift, sectors);
+
+        for (uint32_t i = (offset >> shift); i < last; i++) {
+            if (value) {
+                bits[i / 32] |= (0x1 << (i % 32));
+            }
+            else {
+                bits[i / 32] &= ~(0x1 << (i % 32));
+            }
+        }
+    }
 
-    // init the spi driver
-    spi::init<
-        klib::io::spi::mode::mode3, 1'000'000, 
-        klib::io::spi::bits::bit_8, true
-    >();
+    /**
+     * @brief Returns if a range only has sectors that are erased. The 
+     * range should be aligned to the sectors
+     * 
+     * @param offset 
+     * @param size 
+     * @return true 
+     */
+    static bool marked(const uint32_t offset, const uint32_t size) {
+        if (!size || ((offset | size) & ((0x1 << shift) - 1))) {
+            return false;
+        }
 
-    cs::template set<true>();
+        for (uint32_t i = (offset >> shift); i < ((offset + size) >> shift); i++) {
+            if (i >= sectors || !(bits[i / 32] & (0x1 << (i % 32)))) {
+                return false;
+            }
+        }
 
-    // init the memory using the spi and cs
-    memory::init();
+        return true;
+    }
+}
+#endif
 
-    // // wait until the device is not busy
-    // while (memory::is_busy()) {
-    //     klib::delay<klib::busy_wait>(klib::time::ms{3});
-    // }
+/**
+ * @brief Buffers that are allocated from the heap region during Init. The 
+ * sizes depend on the ram that is left after the stack.
+ * 
+ */
+namespace buffer {
+    // buffer used when reading from the device (blank check, verify)
+    static uint8_t* read = nullptr;
 
-    return 0;
-}
+    // size of the read buffer. Always a multiple of the page size
+    static uint32_t read_size = 0;
 
-int __attribute__ ((noinline)) UnInit(const uint32_t function) {
-    // TODO: implement uninit
+#if DUMP
+    // match table of the dump compressor
+    static uint16_t* table = nullptr;
+#endif
 
-    return 0;
-}
+    /**
+     * @brief Allocate all the buffers from the heap region. Fixed size 
+     * buffers are allocated first. The read buffer gets everything that
+     * is left in the heap region or the ahb sram, whichever is larger.
+     * 
+     * @param size size of the device
+     * @return true when all buffers could be allocated
+     */
+    static bool setup(const uint32_t size) {
+        // release everything from a previous session
+        arena::reset();
+        ahb_arena::reset();
+
+#if SAMPLED_ERASE_VERIFY
+        // allocated first so it is at the same place every Init
+        if (!erased::setup(size)) {
+            return false;
+        }
+#endif
 
-int __attribute__ ((noinline)) EraseSector(const uint32_t sector_address) {   
-    // do a sector erase
-    memory::erase(memory::erase_mode::sector, (sector_address & 0xfffffff));
+#if DUMP
+        table = arena::allocate<uint16_t>(dump::table_size);
 
-    // wait until the device is not busy
-    while (memory::is_busy()) {
-        // wait and do nothing
-        klib::delay<klib::busy_wait>(klib::time::ms{3});
-    }
+        if (table == nullptr) {
+            return false;
+        }
+#endif
 
-    return 0;
-}
+#if TRACE
+        // the trace ring gets half of the heap region that is left, 
+        // rounded down to a power of 2. Allocated before the read buffer
+        // so it is at the same place every Init
+        uint32_t events = (arena::available(alignof(trace::entry)) / 2) / sizeof(trace::entry);
 
-int __attribute__ ((noinline)) ProgramPage(const uint32_t address, const uint32_t size, const uint8_t *const data) {
-    // write the data to the memory device
-    memory::write((address & 0xfffffff), data, size);
+        while (events & (events - 1)) {
+            events &= events - 1;
+        }
 
-    // wait until the device is not busy
-    while (memory::is_busy()) {
-        // wait and do nothing
-        klib::delay<klib::busy_wait>(klib::time::ms{3});
-    }
+        trace::entry *const entries = arena::allocate<trace::entry>(events);
 
-    return 0;
-}
+        if (!events || entries == nullptr) {
+            return false;
+        }
 
-int __attribute__ ((noinline)) SEGGER_OPEN_Program(uint32_t address, uint32_t size, uint8_t *data) {
-    // get the amount of pages to write
-    const uint32_t pages = size >> PAGE_SIZE_SHIFT;
+        tracer::setup(entries, events);
+#endif
 
-    for (uint32_t i = 0; i < pages; i++) {
-        // program a page
-        int r = ProgramPage(address, (0x1 << PAGE_SIZE_SHIFT), data);
+        // get the space that is left in both regions. Round it down to 
+        // a multiple of the page size
+        const uint32_t heap = arena::available() & ~((0x1 << PAGE_SIZE_SHIFT) - 1);
+        const uint32_t ahb = ahb_arena::available() & ~((0x1 << PAGE_SIZE_SHIFT) - 1);
 
-        // check if something went wrong
-        if (r) {
-            // return a error
-            return 1;
+        // give the read buffer the largest region
+        read_size = (ahb > heap) ? ahb : heap;
+
+        // make sure we have at least a single page
+        if (!read_size) {
+            return false;
         }
 
-        address += (0x1 << PAGE_SIZE_SHIFT);
-        data += (0x1 << PAGE_SIZE_SHIFT);
-    }
+        read = (ahb > heap) ? ahb_arena::allocate(read_size) : arena::allocate(read_size);
 
-    // return everything went oke
-    return 0;
+        return read != nullptr;
+    }
 }
 
-#if CHIP_ERASE == true
-    int __attribute__ ((noinline)) EraseChip(void) {
-        // do a chip erase
-        memory::chip_erase();
+/**
+ * @brief Erase units of the device from the largest to the smallest. 
+ * 
+ * <UnitSize> = 2 ^ Shift. Shift = 12 => <UnitSize> = 2 ^ 12 = 4096 bytes
+ * 
+ */
+constexpr static uint8_t erase_shifts[] = {16, 15, 12};
 
-        // wait until the device is not busy
-        while (memory::is_busy()) {
-            // wait and do nothing
-            klib::delay<klib::busy_wait>(klib::time::ms{3});
-        }        
+/**
+ * @brief Erase command and busy time in the part for every unit in 
+ * erase_shifts
+ * 
+ */
+constexpr static struct {
+    // opcode of the erase in the part
+    uint8_t chips::part::* opcode;
+
+    // busy time of the erase in the timings of the part
+    timing::operation timing::device::* timing;
+} erase_units[] = {
+    {&chips::part::block_erase_64k, &timing::device::block_erase_64k},
+    {&chips::part::block_erase_32k, &timing::device::block_erase_32k},
+    {&chips::part::sector_erase, &timing::device::sector_erase},
+};
 
-        return 0;
-    }
-#endif
+// shift that never fits in the address range of the loader. Used for 
+// the erase units the part does not support
+constexpr static uint8_t unsupported_shift = 31;
 
-#if UNIFORM_SECTORS
-    int __attribute__ ((noinline)) SEGGER_OPEN_Erase(uint32_t SectorAddr, uint32_t SectorIndex, uint32_t NumSectors) {
-        // feed the watchdog
-        FeedWatchdog();
+/**
+ * @brief Part that is fitted and the commands used for it. Set in Init 
+ * from the jedec id of the device
+ * 
+ */
+namespace fitted {
+    // geometry, timings and commands of the part. The conservative
+    // part until the device is known
+    static const chips::part* part = &chips::unknown;
+
+    // erase units of the part. Same as erase_shifts with the units the 
+    // part does not support set to unsupported_shift
+    static uint8_t shifts[sizeof(erase_shifts)] = {};
+
+    // read command for the spi clock
+    static nor::cmd read = nor::cmd::read;
+
+    // interval in microseconds between status polls
+    static uint32_t poll_interval = POLL_INTERVAL;
+
+    /**
+     * @brief Configure the command set and polling for a part
+     * 
+     * @param p 
+     * @return true when the loader can use the part
+     */
+    static bool setup(const chips::part& p) {
+        // the loader programs pages of PAGE_SIZE_SHIFT. Smaller pages 
+        // in the part would wrap
+        if (p.page_size < (0x1 << PAGE_SIZE_SHIFT)) {
+            return false;
+        }
 
-        for (uint32_t i = 0; i < NumSectors; i++) {
-            // erase a sector
-            int r = EraseSector((SectorAddr & 0xfffffff));
+        // check if the part can read at the clock of the bus
+        if (SPI_FREQUENCY > (p.fast_read ? p.fast_read_clock : p.read_clock)) {
+            return false;
+        }
 
-            // check for errors
-            if (r) {
-                // return we have a error
-                return 1;
-            }
+        part = &p;
+        read = (SPI_FREQUENCY > p.read_clock) ? nor::cmd::fast_read : nor::cmd::read;
 
-            // go to the next sector address
-            SectorAddr += (1 << SECTOR_SIZE_SHIFT);
+        for (uint32_t i = 0; i < sizeof(shifts); i++) {
+            shifts[i] = (p.*erase_units[i].opcode) ? erase_shifts[i] : unsupported_shift;
         }
 
-        // return everything went oke
-        return 0;
+        // poll at least once every typical page program. The fixed
+        // interval would wait longer than the program itself
+        poll_interval = klib::min(static_cast<uint32_t>(POLL_INTERVAL), p.timing.page_program.typical);
+
+        return true;
     }
-#endif
+}
 
-#if CUSTOM_VERIFY
-    uint32_t __attribute__ ((noinline, __used__)) Verify(uint32_t Addr, uint32_t NumBytes, uint8_t *pBuff) {
-        // TODO: implement verify
+static_assert(
+    (sizeof(erase_shifts) / sizeof(erase_shifts[0])) == (sizeof(erase_units) / sizeof(erase_units[0])), 
+    "Every erase shift needs a erase unit"
+);
+
+#if SAMPLED_ERASE_VERIFY
+    static_assert(
+        erased::shift == erase_shifts[(sizeof(erase_shifts) / sizeof(erase_shifts[0])) - 1],
+        "The erased sectors should be the smallest erase unit"
+    );
+#endif
 
-        return (Addr + NumBytes);
+#if RUNTIME_SECTORS
+    /**
+     * @brief Sector layout used when RUNTIME_SECTORS is enabled. Built in
+     * Init from the size of the detected device. Every sector in this 
+     * layout is a single erase command.
+     * 
+     */
+    static device::flash_sector runtime_sectors[] = {
+        // small sectors where fine granularity is needed
+        {0x1 << erase_shifts[(sizeof(erase_shifts) / sizeof(erase_shifts[0])) - 1], 0x00000000},
+
+        // largest erase unit for the rest of the device
+        {0x1 << erase_shifts[0], RUNTIME_FINE_SIZE},
+        device::end_of_sectors
+    };
+
+    static_assert(
+        (RUNTIME_FINE_SIZE % (0x1 << erase_shifts[0])) == 0,
+        "The fine region should end on the largest erase unit"
+    );
+
+    /**
+     * @brief Create the runtime sector layout for the detected device
+     * 
+     * @param size size of the device
+     */
+    static void runtime_layout(const uint32_t size) {
+        // only use the small sectors when the device is not larger
+        // than the fine region
+        runtime_sectors[1] = (size > RUNTIME_FINE_SIZE) ? 
+            device::flash_sector{0x1 << erase_shifts[0], RUNTIME_FINE_SIZE} :
+            device::end_of_sectors;
     }
 #endif
 
-#if !NATIVE_READ
-    int __attribute__ ((noinline, __used__)) BlankCheck(const uint32_t address, const uint32_t size, const uint8_t blank_value) {
-        static uint8_t buffer[256];
-        
-        // read all the memory and compare it with the blank value
-        for (uint32_t i = 0; i < size; /* do not update i here */) {
-            // get the size to read
-            const uint32_t s = klib::min(size - i, sizeof(buffer));
+/**
+ * @brief Wait until the device is not busy anymore. Gives up when the 
+ * device is still busy after the timeout. This prevents a stuck or 
+ * missing device from hanging the loader until J-Link gives up. Always
+ * polls the device as it is used for operations the model does not know
+ * about.
+ * 
+ * @param timeout timeout in microseconds
+ * @return true when the device is ready
+ * @return false when the device is still busy after the timeout
+ */
+static bool wait_ready(const uint32_t timeout) {
+    tracer::scope trace(trace::event::busy);
 
-            // read memory from device
-            memory::read((address & 0xfffffff) + i, buffer, s);
+    for (uint32_t waited = 0; nor::poll(); waited += fitted::poll_interval) {
+        // check if we have waited long enough
+        if (waited >= timeout) {
+            return false;
+        }
 
-            // check if all the data matches the blank value
-            for (uint32_t j = 0; j < s; j++) {
-                if (buffer[j] != blank_value) {
-                    return 1;
-                }
-            }
+        // mark we are still alive
+        progress::scope::poll();
 
-            // update i
-            i += s;
-        }
+        // wait and do nothing
+        klib::delay<klib::busy_wait>(klib::time::us{fitted::poll_interval});
+    }
 
-        return 0;
+    return true;
+}
+
+/**
+ * @brief Wait until the device answers the jedec id. Releases the device
+ * from deep power-down when it does not answer right away. 
+ * 
+ * @return true when the device answered within the power-up time
+ * @return false when no device answered
+ */
+static bool wait_present() {
+    // check if the device answers right away. This is the normal case
+    if (nor::valid(nor::jedec_id())) {
+        return true;
     }
 
-    int __attribute__ ((noinline, __used__)) SEGGER_OPEN_Read(const uint32_t address, const uint32_t size, uint8_t *const data) {
-        // read memory
-        memory::read((address & 0xfffffff), data, size);
+    // the device might be left in continuous read mode by the previous 
+    // user. Clear it and try again
+    nor::reset_continuous();
 
-        return size;
+    if (nor::valid(nor::jedec_id())) {
+        return true;
     }
-#endif
 
-#if RUNTIME_SECTORS
-    int __attribute__ ((noinline, __used__)) SEGGER_OPEN_GetFlashInfo(flash_info *const info, uint32_t InfoAreaSize) {
-        // set the sector count (max is 7)
-        info->count = 7;
+    // the device might be in deep power-down. Release it
+    nor::send(nor::cmd::release_power_down);
+
+    // the device might still be powering up, so the wait is bounded by 
+    // the power-up time and not only the release time. Uses the cycle 
+    // counter as every jedec id read takes longer than the poll interval.
+    // The part is not known yet so the slowest part is used
+    const uint32_t start = cycles::get();
+    constexpr uint32_t timeout = (
+        (chips::unknown.timing.power_up.maximum + chips::unknown.timing.release_power_down.maximum) * 
+        (cpu_frequency / 1'000'000)
+    );
+
+    // wait until the device answers
+    while (!nor::valid(nor::jedec_id())) {
+        // check if we have waited long enough
+        if ((cycles::get() - start) >= timeout) {
+            return false;
+        }
 
-        // set the flash data
-        for (uint32_t i = 0; i < info->count; i++) {
-            // set every sector (data pointer points is not set to something specific)
-            info->sectors[i] = {
-                // set the start offset for the current sector
-                .offset = i * 0x100,
-                
-                // set the sector size
-                .size = 0x100,
+        // mark we are still alive
+        progress::scope::poll();
 
-                // set the amount of sectors in the section
-                .amount = 10,
-            };
+        klib::delay<klib::busy_wait>(klib::time::us{READY_POLL_INTERVAL});
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check if a buffer only contains the blank value. Compares a word
+ * at a time with 4 words per check. The data should be word aligned
+ * 
+ * @param data 
+ * @param size 
+ * @param blank_value 
+ * @return true when the whole buffer is blank
+ */
+static bool blank_kernel(const uint8_t *const data, const uint32_t size, const uint8_t blank_value) {
+    // blank value in every byte of a word
+    const uint32_t pattern = blank_value * 0x01010101;
+
+    const uint32_t *const words = reinterpret_cast<const uint32_t*>(data);
+    const uint32_t count = size / sizeof(uint32_t);
+
+    uint32_t i = 0;
+
+    // check 4 words at once. Only a single branch for 16 bytes
+    for (; (i + 4) <= count; i += 4) {
+        if ((words[i] ^ pattern) | (words[i + 1] ^ pattern) | 
+            (words[i + 2] ^ pattern) | (words[i + 3] ^ pattern)) 
+        {
+            return false;
+        }
+    }
+
+    // check the words that are left
+    for (; i < count; i++) {
+        if (words[i] != pattern) {
+            return false;
+        }
+    }
+
+    // check the bytes that are left
+    for (uint32_t j = (count * sizeof(uint32_t)); j < size; j++) {
+        if (data[j] != blank_value) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// size of a single read command when the data is streamed without a 
+// read buffer. The progress is updated after every chunk
+constexpr static uint32_t stream_chunk = 0x1000;
+
+/**
+ * @brief Check if a range only contains the blank value. Reads the range 
+ * in chunks of the read buffer and stops at the first chunk that is not 
+ * blank
+ * 
+ * @param address 
+ * @param size 
+ * @param blank_value 
+ * @return true when the whole range is blank
+ */
+static bool is_blank(const uint32_t address, const uint32_t size, const uint8_t blank_value) {
+    // read all the memory and compare it with the blank value
+    for (uint32_t i = 0; i < size; /* do not update i here */) {
+        // get the size to read
+        const uint32_t s = klib::min(size - i, buffer::read_size);
+
+        // read memory from device
+        tracer::begin(trace::event::read);
+        nor::read(fitted::read, (address & 0xfffffff) + i, buffer::read, s);
+        tracer::end(trace::event::read);
+
+        // check if all the data matches the blank value
+        tracer::begin(trace::event::blank);
+        const bool blank = blank_kernel(buffer::read, s, blank_value);
+        tracer::end(trace::event::blank);
+
+        if (!blank) {
+            return false;
+        }
+
+        // update i
+        i += s;
+
+        progress::scope::advance(s);
+    }
+
+    return true;
+}
+
+#if CALC_CRC || PROGRAM_BATCH
+/**
+ * @brief Add a range of the device to a crc. Every byte is added as it 
+ * is received
+ * 
+ * @param result 
+ * @param address 
+ * @param size 
+ */
+static void read_crc(crc32& result, const uint32_t address, const uint32_t size) {
+    for (uint32_t i = 0; i < size; i += stream_chunk) {
+        const uint32_t s = klib::min(size - i, stream_chunk);
+
+        tracer::begin(trace::event::crc);
+        nor::read(fitted::read, (address & 0xfffffff) + i, s, [&](const uint8_t value) {
+            result.update(value);
+
+            return true;
+        });
+        tracer::end(trace::event::crc);
+
+        progress::scope::advance(s);
+    }
+}
+#endif
+
+#if SAMPLED_ERASE_VERIFY
+    /**
+     * @brief Check a sample of the words of a sector. Checks the first 
+     * and last word of every page and pseudo-random words. The same 
+     * sector always gets the same sample
+     * 
+     * @param sector offset of the sector
+     * @param blank_value 
+     * @return true when all the words in the sample are blank
+     */
+    static bool sample_blank(const uint32_t sector, const uint8_t blank_value) {
+        constexpr uint32_t sector_size = (0x1 << erased::shift);
+        constexpr uint32_t page_size = (0x1 << PAGE_SIZE_SHIFT);
+
+        // blank value in every byte of a word
+        const uint32_t pattern = blank_value * 0x01010101;
+        uint32_t words[2];
+
+        // first word of the sector
+        nor::read(fitted::read, sector, reinterpret_cast<uint8_t*>(words), sizeof(uint32_t));
+
+        if (words[0] != pattern) {
+            return false;
+        }
+
+        // the last word of a page and the first word of the next page
+        // are next to each other. Read them at once
+        for (uint32_t page = page_size; page < sector_size; page += page_size) {
+            nor::read(fitted::read, sector + page - sizeof(uint32_t), reinterpret_cast<uint8_t*>(words), sizeof(words));
+
+            if ((words[0] ^ pattern) | (words[1] ^ pattern)) {
+                return false;
+            }
+        }
+
+        // last word of the sector
+        nor::read(fitted::read, sector + sector_size - sizeof(uint32_t), reinterpret_cast<uint8_t*>(words), sizeof(uint32_t));
+
+        if (words[0] != pattern) {
+            return false;
+        }
+
+        // xorshift seeded with the sector
+        uint32_t seed = sector | 0x1;
+
+        for (uint32_t i = 0; i < ERASE_VERIFY_SAMPLES; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+
+            const uint32_t offset = (seed % (sector_size / sizeof(uint32_t))) * sizeof(uint32_t);
+
+            nor::read(fitted::read, sector + offset, reinterpret_cast<uint8_t*>(words), sizeof(uint32_t));
+
+            if (words[0] != pattern) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Blank check erased sectors using a sample of every sector.
+     * Reads the whole sector when the sample is not blank
+     * 
+     * @param offset sector aligned offset
+     * @param size multiple of the sector size
+     * @param blank_value 
+     * @return true when the range is blank
+     */
+    static bool verify_erased(const uint32_t offset, const uint32_t size, const uint8_t blank_value) {
+        for (uint32_t sector = offset; sector < (offset + size); sector += (0x1 << erased::shift)) {
+            tracer::begin(trace::event::blank);
+            const bool blank = sample_blank(sector, blank_value);
+            tracer::end(trace::event::blank);
+
+            if (blank) {
+                progress::scope::advance(0x1 << erased::shift);
+                continue;
+            }
+
+            // escalate to a full scan of the sector
+            if (!is_blank(sector, (0x1 << erased::shift), blank_value)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+#endif
+
+/**
+ * @brief Returns if the device is busy. Used by wait_done to wait for the
+ * device
+ * 
+ * @return true 
+ */
+static bool busy() {
+    return nor::busy();
+}
+
+/**
+ * @brief Convert a time in microseconds to cpu cycles
+ * 
+ * @param us 
+ * @return uint32_t 
+ */
+constexpr static uint32_t to_cycles(const uint32_t us) {
+    return us * (cpu_frequency / 1'000'000);
+}
+
+/**
+ * @brief Wait until the operation the loader started is done. Only polls
+ * the device when the model does not know the answer. Gives up when the
+ * device is still busy after the timeout
+ * 
+ * @param timeout timeout in cpu cycles
+ * @return true when the device is ready
+ * @return false when the device is still busy after the timeout
+ */
+static bool wait_done(const uint32_t timeout) {
+    const uint32_t start = cycles::get();
+
+    while (busy()) {
+        // check if we have waited long enough
+        if ((cycles::get() - start) >= timeout) {
+            return false;
+        }
+
+        // mark we are still alive
+        progress::scope::poll();
+
+        // wait and do nothing
+        klib::delay<klib::busy_wait>(klib::time::us{fitted::poll_interval});
+    }
+
+    return true;
+}
+
+/**
+ * @brief Erase a sector aligned range using the least amount of erase 
+ * commands the sector layout allows
+ * 
+ * @param start offset of the first sector
+ * @param end offset after the last sector
+ * @param select when set only the erase units it returns true for are 
+ * erased. The plan does not change
+ * @return int 0 = OK, 1 = Failed
+ */
+static int erase_range(const uint32_t start, const uint32_t end, bool (*const select)(const uint32_t, const uint32_t) = nullptr) {
+    geometry::planner plan(fitted::shifts, start, end);
+    decltype(plan)::step step;
+
+    while (plan.next(step)) {
+        if (select && !select(step.offset, (0x1 << erase_shifts[step.unit]))) {
+            continue;
+        }
+
+        // erase the next part of the range
+        tracer::begin(trace::event::erase);
+        nor::erase(
+            fitted::part->*erase_units[step.unit].opcode, step.offset, 
+            to_cycles((fitted::part->timing.*erase_units[step.unit].timing).typical)
+        );
+        tracer::end(trace::event::erase);
+
+        // wait until the device is not busy
+        tracer::begin(trace::event::busy);
+        const bool ready = wait_done(
+            to_cycles((fitted::part->timing.*erase_units[step.unit].timing).maximum)
+        );
+        tracer::end(trace::event::busy);
+
+        // stop when the device did not do what the model expected
+        if (!ready || !chip_state::consistent()) {
+            return 1;
+        }
+
+#if SAMPLED_ERASE_VERIFY
+        erased::mark(step.offset, (0x1 << erase_shifts[step.unit]), true);
+#endif
+
+        progress::scope::advance(0x1 << erase_shifts[step.unit]);
+    }
+
+    // check if the plan covered everything
+    return plan.done() ? 0 : 1;
+}
+
+/**
+ * @brief Get the next page that does not only have the erase value. 
+ * Programming those pages does not change the device. Returns the offset
+ * when SKIP_ERASED_PAGES is disabled
+ * 
+ * @param data 
+ * @param offset offset of the page to start at
+ * @param size 
+ * @return uint32_t offset of the page. size when there is none
+ */
+static uint32_t next_page(const uint8_t *const data, uint32_t offset, const uint32_t size) {
+#if SKIP_ERASED_PAGES
+    for (; offset < size; offset += (0x1 << PAGE_SIZE_SHIFT)) {
+        const uint32_t s = klib::min(size - offset, static_cast<uint32_t>(0x1 << PAGE_SIZE_SHIFT));
+
+        for (uint32_t i = 0; i < s; i++) {
+            if (data[offset + i] != FlashDevice.erase_value) {
+                return offset;
+            }
+        }
+    }
+
+    return size;
+#else
+    return offset;
+#endif
+}
+
+/**
+ * @brief Program pages. Pages with only the erase value are skipped when
+ * SKIP_ERASED_PAGES is enabled. The next page is searched while the 
+ * device is busy with the current one
+ * 
+ * @param address 
+ * @param size 
+ * @param data 
+ * @return int 0 = OK, 1 = Failed
+ */
+static int program_range(const uint32_t address, const uint32_t size, const uint8_t *const data) {
+    // time before the first status poll of a page
+    const uint32_t program_cycles = to_cycles(fitted::part->timing.page_program.typical);
+
+    uint32_t offset = next_page(data, 0, size);
+
+    progress::scope::advance(offset);
+
+    while (offset < size) {
+        const uint32_t s = klib::min(size - offset, static_cast<uint32_t>(0x1 << PAGE_SIZE_SHIFT));
+
+        // write the data to the memory device
+        tracer::begin(trace::event::transfer);
+
+#if QUAD_PROGRAM
+        if (fitted::part->quad_program) {
+            quad::write((address & 0xfffffff) + offset, data + offset, s, program_cycles);
+        }
+        else {
+            nor::write((address & 0xfffffff) + offset, data + offset, s, program_cycles);
+        }
+#else
+        nor::write((address & 0xfffffff) + offset, data + offset, s, program_cycles);
+#endif
+
+        tracer::end(trace::event::transfer);
+
+#if SAMPLED_ERASE_VERIFY
+        // the sector is not erased anymore
+        erased::mark((address & 0xfffffff) + offset, s, false);
+#endif
+
+        // find the next page while the device is programming
+        const uint32_t next = next_page(data, offset + s, size);
+
+        // wait until the device is not busy
+        tracer::begin(trace::event::busy);
+        const bool ready = wait_done(to_cycles(fitted::part->timing.page_program.maximum));
+        tracer::end(trace::event::busy);
+
+        if (!ready || !chip_state::consistent()) {
+            return 1;
+        }
+
+        progress::scope::advance(next - offset);
+
+        offset = next;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Erase the whole device
+ * 
+ * @return int 0 = OK, 1 = Failed
+ */
+static int erase_device() {
+    // do a chip erase
+    tracer::begin(trace::event::erase);
+    nor::chip_erase(to_cycles(fitted::part->timing.chip_erase.typical));
+    tracer::end(trace::event::erase);
+
+    // wait until the device is not busy
+    tracer::begin(trace::event::busy);
+    const bool ready = wait_done(to_cycles(fitted::part->timing.chip_erase.maximum));
+    tracer::end(trace::event::busy);
+
+    if (!ready || !chip_state::consistent()) {
+        return 1;
+    }
+
+#if SAMPLED_ERASE_VERIFY
+    erased::mark(0, (erased::sectors << erased::shift), true);
+#endif
+
+    progress::scope::advance(FlashDevice.size);
+
+    return 0;
+}
+
+/**
+ * @brief array with all the functions for the segger software
+ * 
+ */
+extern "C" {
+    // declaration for the OFL Api. If we initialize it here we get
+    // a wrong name in the symbol table
+    extern const uint32_t SEGGER_OFL_Api[];
+}
+
+// definition of OFL Api
+const uint32_t SEGGER_OFL_Api[] __attribute__ ((section ("PrgCode"), __used__)) = {
+    reinterpret_cast<uint32_t>(FeedWatchdog),
+    reinterpret_cast<uint32_t>(Init),
+    reinterpret_cast<uint32_t>(UnInit),
+    reinterpret_cast<uint32_t>(EraseSector),
+    reinterpret_cast<uint32_t>(ProgramPage),
+    reinterpret_cast<uint32_t>(BLANK_CHECK_FUNC),
+    reinterpret_cast<uint32_t>(CHIP_ERASE_FUNC),
+    reinterpret_cast<uint32_t>(VERIFY_FUNC),
+    reinterpret_cast<uint32_t>(CALC_CRC_FUNC),
+    reinterpret_cast<uint32_t>(OPEN_READ_FUNC),
+    reinterpret_cast<uint32_t>(SEGGER_OPEN_Program),
+    reinterpret_cast<uint32_t>(UNIFORM_ERASE_FUNC),
+    reinterpret_cast<uint32_t>(nullptr), // SEGGER_OPEN_Start for turbo mode
+    reinterpret_cast<uint32_t>(RUNTIME_SECTORS_FUNC),
+};
+
+#if HASH_RANGE
+    #define HASH_RANGE_FUNC HashRange
+#else
+    #define HASH_RANGE_FUNC nullptr
+#endif
+
+#if ESTIMATE
+    #define ESTIMATE_FUNC Estimate
+#else
+    #define ESTIMATE_FUNC nullptr
+#endif
+
+#if DUMP
+    #define DUMP_FUNC Dump
+#else
+    #define DUMP_FUNC nullptr
+#endif
+
+#if EXTENTS
+    #define EXTENTS_FUNC Extents
+#else
+    #define EXTENTS_FUNC nullptr
+#endif
+
+#if PROGRAM_BATCH
+    #define PROGRAM_BATCH_FUNC ProgramBatch
+#else
+    #define PROGRAM_BATCH_FUNC nullptr
+#endif
+
+/**
+ * @brief array with all the loader extensions. Not used by the segger 
+ * software. Keeps the extensions in the binary and gives the host a 
+ * fixed order to find them
+ * 
+ */
+extern "C" {
+    // declaration for the extension Api. If we initialize it here we get
+    // a wrong name in the symbol table
+    extern const uint32_t OFL_Extension_Api[];
+}
+
+// definition of the extension Api
+const uint32_t OFL_Extension_Api[] __attribute__ ((section ("PrgCode"), __used__)) = {
+    reinterpret_cast<uint32_t>(HASH_RANGE_FUNC),
+    reinterpret_cast<uint32_t>(ESTIMATE_FUNC),
+    reinterpret_cast<uint32_t>(DUMP_FUNC),
+    reinterpret_cast<uint32_t>(EXTENTS_FUNC),
+    reinterpret_cast<uint32_t>(PROGRAM_BATCH_FUNC),
+};
+
+void __attribute__ ((noinline)) FeedWatchdog(void) {
+    // TODO: implement something to keep the watchdog happy
+    return;
+}
+
+// J-Link calls Init first and never runs the reset handler. Init is in 
+// the entry section so it is never packed and can unpack the rest of the
+// loader before anything else is used
+int __attribute__ ((noinline, section(".entry"))) Init(const uint32_t address, const uint32_t frequency, const uint32_t function) {
+    using clock = target::io::system::clock;
+
+    // unpack the loader when it is packed. Does nothing after the first
+    // call of a download
+    __unpack_loader();
+
+    // enable the cycle counter for the progress timestamps
+    cycles::init();
+
+    // the progress record is not initialized when the loader is 
+    // downloaded. Clear it before using it
+    LoaderProgress.current = progress::operation::idle;
+
+    // the start of Init is traced after the clock switch, the cycle
+    // counter runs at the internal oscillator before it. It is recorded
+    // once the trace ring is allocated
+    call_scope scope(progress::operation::init, 0, false);
+
+    // setup the flash wait state to 4 + 1 CPU clocks
+    target::io::system::flash::setup<4>();
+
+    // setup the clock to 96Mhz (this is using the internal 4Mhz oscillator)
+    // (((47 + 1) * 2 * 4Mhz) / (0 + 1) = 384Mhz) / (3 + 1) = 96Mhz
+    clock::set_main<clock::source::internal, 4'000'000, 48, 1, 4>();
+
+    const uint32_t start = cycles::get();
+
+    // init the cs pin
+    cs::init();
+
+    // init the spi driver
+    spi::init<
+        klib::io::spi::mode::mode3, SPI_FREQUENCY, 
+        klib::io::spi::bits::bit_8, true
+    >();
+
+    cs::template set<true>();
+
+    // nothing is known about the device until it is synced at the end
+    chip_state::reset();
+
+    // wait until the device answers. This replaces the fixed power-up 
+    // and reset delays of the memory driver
+    if (!wait_present()) {
+        return 2;
+    }
+
+    // use the command set of the part that is fitted. Unknown devices
+    // use the commands every part supports with the slowest timings
+    const uint32_t id = nor::jedec_id();
+    const chips::part& part = chips::find(id);
+
+    if (!fitted::setup(part)) {
+        return 1;
+    }
+
+#if RUNTIME_SECTORS
+    // get the size from the part or the device. Use the size of the flash
+    // device when the device does not report a usable size
+    uint32_t size = part.size ? part.size : nor::capacity(id);
+
+    if (!size) {
+        size = FlashDevice.size;
+    }
+
+    runtime_layout(size);
+
+    // create the lookup table for the sector layout J-Link gets
+    if (!geometry::table::build(runtime_sectors, size)) {
+        return 1;
+    }
+#else
+    const uint32_t size = FlashDevice.size;
+
+    // create the lookup table for the sector layout
+    if (!geometry::table::build(FlashDevice.sectors, size)) {
+        return 1;
+    }
+#endif
+
+    // setup the buffers using the ram that is available
+    if (!buffer::setup(size)) {
+        return 1;
+    }
+
+    // nothing is traced before the buffers are allocated
+    tracer::begin_at(start, trace::event::call, static_cast<uint8_t>(progress::operation::init));
+
+    // wait until a operation from a previous session is done
+    if (!wait_ready(part.timing.chip_erase.maximum)) {
+        return 1;
+    }
+
+    // the device is idle. Everything the loader sends from now on is 
+    // tracked by the model
+    nor::sync();
+
+#if QUAD_PROGRAM
+    if (part.quad_program) {
+        quad::init();
+
+        // set the quad enable bit and wait until the status register 
+        // is written
+        quad::enable(to_cycles(part.timing.write_status.typical));
+
+        if (!wait_ready(part.timing.write_status.maximum)) {
+            return 1;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+int __attribute__ ((noinline)) UnInit(const uint32_t function) {
+#if QUAD_PROGRAM
+    if (fitted::part->quad_program) {
+        // restore the quad enable bit
+        quad::disable(to_cycles(fitted::part->timing.write_status.typical));
+
+        if (!wait_ready(fitted::part->timing.write_status.maximum)) {
+            return 1;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+int __attribute__ ((noinline)) EraseSector(const uint32_t sector_address) {   
+    const uint32_t offset = (sector_address & 0xfffffff);
+
+    // get the size of the sector
+    const geometry::region *const region = geometry::table::find(offset);
+
+    if (region == nullptr) {
+        return 1;
+    }
+
+    const uint32_t size = (0x1 << region->shift);
+    call_scope scope(progress::operation::erase, size);
+
+    // erase the sector
+    return erase_range(offset, offset + size);
+}
+
+int __attribute__ ((noinline)) ProgramPage(const uint32_t address, const uint32_t size, const uint8_t *const data) {
+    call_scope scope(progress::operation::program, size);
+
+    return program_range(address, size, data);
+}
+
+int __attribute__ ((noinline)) SEGGER_OPEN_Program(uint32_t address, uint32_t size, uint8_t *data) {
+    // only program full pages
+    const uint32_t pages = size >> PAGE_SIZE_SHIFT;
+
+    call_scope scope(progress::operation::program, pages << PAGE_SIZE_SHIFT);
+
+    // program all the pages in a single call
+    return program_range(address, pages << PAGE_SIZE_SHIFT, data);
+}
+
+#if CHIP_ERASE == true
+    int __attribute__ ((noinline)) EraseChip(void) {
+        call_scope scope(progress::operation::erase_chip, FlashDevice.size);
+
+        return erase_device();
+    }
+#endif
+
+#if UNIFORM_SECTORS
+    int __attribute__ ((noinline)) SEGGER_OPEN_Erase(uint32_t SectorAddr, uint32_t SectorIndex, uint32_t NumSectors) {
+        // feed the watchdog
+        FeedWatchdog();
+
+        const uint32_t start = (SectorAddr & 0xfffffff);
+        uint32_t end;
+
+        // get the end of the last sector to erase
+        if (!geometry::table::offset(SectorIndex + NumSectors, end) || end < start) {
+            return 1;
+        }
+
+        call_scope scope(progress::operation::erase, end - start);
+
+        // erase all the sectors using the largest erase commands that fit
+        return erase_range(start, end);
+    }
+#endif
+
+#if CUSTOM_VERIFY
+    uint32_t __attribute__ ((noinline, __used__)) Verify(const uint32_t address, const uint32_t size, uint8_t *const data) {
+        call_scope scope(progress::operation::verify, size);
+
+        for (uint32_t i = 0; i < size; i += stream_chunk) {
+            const uint32_t s = klib::min(size - i, stream_chunk);
+
+            // offset of the next byte to compare
+            uint32_t offset = i;
+
+            // compare every byte as it is received. Stops the read at the
+            // first difference
+            tracer::begin(trace::event::read);
+            nor::read(fitted::read, (address & 0xfffffff) + i, s, [&](const uint8_t value) {
+                if (value != data[offset]) {
+                    return false;
+                }
+
+                offset++;
+
+                return true;
+            });
+            tracer::end(trace::event::read);
+
+            if (offset != (i + s)) {
+                return address + offset;
+            }
+
+            scope.advance(s);
+        }
+
+        return address + size;
+    }
+#endif
+
+#if CALC_CRC
+    uint32_t __attribute__ ((noinline, __used__)) SEGGER_OPEN_CalcCRC(const uint32_t crc, const uint32_t address, const uint32_t size, const uint32_t polynomial) {
+        call_scope scope(progress::operation::crc, size);
+
+        crc32 result(polynomial, crc);
+
+        read_crc(result, address, size);
+
+        return result.get();
+    }
+#endif
+
+#if !NATIVE_READ
+    int __attribute__ ((noinline, __used__)) BlankCheck(const uint32_t address, const uint32_t size, const uint8_t blank_value) {
+        call_scope scope(progress::operation::blank_check, size);
+
+#if SAMPLED_ERASE_VERIFY
+        // only sample the sectors the loader erased
+        if (erased::marked(address & 0xfffffff, size)) {
+            return verify_erased(address & 0xfffffff, size, blank_value) ? 0 : 1;
+        }
+#endif
+
+        return is_blank(address, size, blank_value) ? 0 : 1;
+    }
+
+    int __attribute__ ((noinline, __used__)) SEGGER_OPEN_Read(const uint32_t address, const uint32_t size, uint8_t *const data) {
+        call_scope scope(progress::operation::read, size);
+
+        // read memory
+        tracer::begin(trace::event::read);
+        nor::read(fitted::read, (address & 0xfffffff), data, size);
+        tracer::end(trace::event::read);
+
+        scope.advance(size);
+
+        return size;
+    }
+#endif
+
+#if RUNTIME_SECTORS
+    int __attribute__ ((noinline, __used__)) SEGGER_OPEN_GetFlashInfo(flash_info *const info, uint32_t InfoAreaSize) {
+        // check if the layout fits in the info area of J-Link
+        if (InfoAreaSize < sizeof(flash_info) || geometry::table::size() > max_info_sectors) {
+            return 1;
+        }
+
+        // set the sector count (max is 7)
+        info->count = geometry::table::size();
+
+        // give J-Link the same layout the erase functions use. Every 
+        // sector J-Link erases is a single erase command
+        for (uint32_t i = 0; i < info->count; i++) {
+            const geometry::region& region = geometry::table::at(i);
+
+            info->sectors[i] = {
+                // set the start offset for the current sector
+                .offset = region.start,
+                
+                // set the sector size
+                .size = (0x1u << region.shift),
+
+                // set the amount of sectors in the section
+                .amount = (region.end - region.start) >> region.shift,
+            };
+        }
+
+        return 0;
+    }
+#endif
+
+#if HASH_RANGE
+    int __attribute__ ((noinline, __used__)) HashRange(const uint32_t address, const uint32_t size, uint8_t *const digest) {
+        call_scope scope(progress::operation::hash, size);
+
+        // static to keep the hash state off the stack
+        static sha256 hash;
+
+        hash.init();
+
+        // read the memory in chunks and hash every chunk
+        for (uint32_t i = 0; i < size; /* do not update i here */) {
+            // get the size to read
+            const uint32_t s = klib::min(size - i, buffer::read_size);
+
+            // read memory from device
+            tracer::begin(trace::event::read);
+            nor::read(fitted::read, (address & 0xfffffff) + i, buffer::read, s);
+            tracer::end(trace::event::read);
+
+            // add the data to the hash
+            tracer::begin(trace::event::hash);
+            hash.update(buffer::read, s);
+            tracer::end(trace::event::hash);
+
+            // update i
+            i += s;
+
+            scope.advance(s);
+        }
+
+        // write the digest to the buffer of the host
+        hash.finish(digest);
+
+        return 0;
+    }
+#endif
+
+#if ESTIMATE
+    /**
+     * @brief Add the cost of a single operation that keeps the device busy
+     * 
+     * @param result 
+     * @param bytes bytes of the command including the write enable
+     * @param busy typical and maximum busy time of the operation
+     */
+    static void estimate_operation(estimate *const result, const uint32_t bytes, const timing::operation& busy) {
+        // the device is first polled after the typical time of the 
+        // operation and then every poll interval until the maximum time
+        const uint32_t polls = 1 + (
+            ((busy.maximum - busy.typical) + (fitted::poll_interval - 1)) / fitted::poll_interval
+        );
+
+        // write enable + command + status polls
+        result->commands += 2 + polls;
+        result->bus_bytes += bytes + (polls * 2);
+        result->busy_time += busy.typical;
+    }
+
+    /**
+     * @brief Add the cost of reading a range with commands of at most 
+     * chunk bytes
+     * 
+     * @param result 
+     * @param size 
+     * @param chunk 
+     */
+    static void estimate_read(estimate *const result, const uint32_t size, const uint32_t chunk) {
+        // opcode, address and the dummy byte of a fast read
+        const uint32_t header = 4 + (fitted::read == nor::cmd::fast_read ? 1 : 0);
+        const uint32_t commands = (size + (chunk - 1)) / chunk;
+
+        result->commands += commands;
+        result->bus_bytes += size + (commands * header);
+    }
+
+#if SAMPLED_ERASE_VERIFY
+    /**
+     * @brief Add the cost of the blank check J-Link does after the erase 
+     * of sectors the loader marked as erased. Same reads as sample_blank
+     * 
+     * @param result 
+     * @param sectors amount of sectors
+     */
+    static void estimate_sampled(estimate *const result, const uint32_t sectors) {
+        constexpr uint32_t pages = (0x1 << (erased::shift - PAGE_SIZE_SHIFT));
+
+        for (uint32_t i = 0; i < sectors; i++) {
+            // first word, the two words around every page boundary, the
+            // last word and the pseudo-random words
+            estimate_read(result, sizeof(uint32_t), sizeof(uint32_t));
+            estimate_read(result, (pages - 1) * 2 * sizeof(uint32_t), 2 * sizeof(uint32_t));
+            estimate_read(result, sizeof(uint32_t), sizeof(uint32_t));
+            estimate_read(result, ERASE_VERIFY_SAMPLES * sizeof(uint32_t), sizeof(uint32_t));
+        }
+    }
+#endif
+
+    int __attribute__ ((noinline, __used__)) Estimate(const uint32_t function, const uint32_t address, const uint32_t size, estimate *const result) {
+        call_scope scope(progress::operation::estimate, size);
+
+        const uint32_t offset = (address & 0xfffffff);
+        const uint32_t page_size = (0x1 << PAGE_SIZE_SHIFT);
+
+        (*result) = {};
+
+        switch (function) {
+            case 1: {
+                // erase. Plan the erase the same way SEGGER_OPEN_Erase does
+                geometry::planner plan(fitted::shifts, offset, offset + size);
+                decltype(plan)::step step;
+
+                while (plan.next(step)) {
+                    const uint32_t unit = (0x1 << erase_shifts[step.unit]);
+
+                    // write enable + erase command with address
+                    estimate_operation(result, 1 + 4, fitted::part->timing.*erase_units[step.unit].timing);
+
+                    // check if this part of the erase could be skipped
+                    if (is_blank(step.offset, unit, FlashDevice.erase_value)) {
+                        result->blank += unit;
+                    }
+                }
+
+                // check if the range is not aligned to the sectors
+                if (!plan.done()) {
+                    return 1;
+                }
+
+#if SAMPLED_ERASE_VERIFY
+                // the blank check after the erase only samples the sectors
+                estimate_sampled(result, size >> erased::shift);
+#endif
+                break;
+            }
+            case 2:
+                // program. Check every page if it can be programmed without
+                // a erase first
+                for (uint32_t i = 0; i < size; i += page_size) {
+                    // the last page can be partial
+                    const uint32_t s = klib::min(size - i, page_size);
+
+                    // write enable + program command with address and data
+                    estimate_operation(result, 1 + 4 + s, fitted::part->timing.page_program);
+
+                    if (is_blank(offset + i, s, FlashDevice.erase_value)) {
+                        result->blank += s;
+                    }
+                }
+                break;
+            case 3:
+#if SAMPLED_ERASE_VERIFY
+                // the sectors the loader erased are only sampled
+                if (erased::marked(offset, size)) {
+                    estimate_sampled(result, size >> erased::shift);
+                }
+                else {
+                    estimate_read(result, size, buffer::read_size);
+                }
+#else
+                // blank check. A read command for every chunk of the read
+                // buffer
+                estimate_read(result, size, buffer::read_size);
+#endif
+
+                // the first chunk that is not blank stops the blank check
+                if (is_blank(offset, size, FlashDevice.erase_value)) {
+                    result->blank = size;
+                }
+                break;
+            case 4:
+                // chip erase
+                estimate_operation(result, 1 + 1, fitted::part->timing.chip_erase);
+                break;
+            default:
+                return 1;
+        }
+
+        return 0;
+    }
+#endif
+
+#if DUMP
+    int __attribute__ ((noinline, __used__)) Dump(const uint32_t address, const uint32_t size, uint8_t *const data, const uint32_t capacity) {
+        call_scope scope(progress::operation::dump, size);
+
+        // make sure the compressed data always fits
+        if (capacity < dump::worst_case(size)) {
+            return -1;
+        }
+
+        dump::compressor compressor;
+        uint32_t written = 0;
+
+        // compress the memory in chunks of the read buffer
+        for (uint32_t i = 0; i < size; /* do not update i here */) {
+            // get the size to read
+            const uint32_t s = klib::min(size - i, klib::min(buffer::read_size, dump::max_chunk));
+
+            // read memory from device
+            nor::read(fitted::read, (address & 0xfffffff) + i, buffer::read, s);
+
+            // compress the chunk directly in the buffer of the host
+            written += compressor.compress(
+                buffer::read, s, data + written, buffer::table, FlashDevice.erase_value
+            );
+
+            // update i
+            i += s;
+
+            scope.advance(s);
+        }
+
+        return written;
+    }
+#endif
+
+#if EXTENTS
+    int __attribute__ ((noinline, __used__)) Extents(const uint32_t address, const uint32_t size, extent *const list, const uint32_t max) {
+        call_scope scope(progress::operation::extents, size);
+
+        const uint32_t start = (address & 0xfffffff);
+        const uint32_t end = start + size;
+
+        // amount of extents in the list
+        uint32_t count = 0;
+
+        for (uint32_t offset = start; offset < end; /* do not update offset here */) {
+            // get the sector the offset is in
+            const geometry::region *const region = geometry::table::find(offset);
+
+            if (region == nullptr) {
+                return -1;
+            }
+
+            // get the end of the sector. Never past the range
+            const uint32_t sector = (offset & ~((0x1 << region->shift) - 1)) + (0x1 << region->shift);
+            const uint32_t limit = klib::min(sector, end);
+
+            // check the sector in chunks of the read buffer. Stops at the
+            // first chunk with data
+            bool blank = true;
+
+            for (uint32_t i = offset; blank && i < limit; /* do not update i here */) {
+                // get the size to read
+                const uint32_t s = klib::min(limit - i, buffer::read_size);
+
+                // read memory from device
+                nor::read(fitted::read, i, buffer::read, s);
+
+                blank = blank_kernel(buffer::read, s, FlashDevice.erase_value);
+
+                // update i
+                i += s;
+            }
+
+            if (!blank) {
+                // merge with the previous extent when they are next to 
+                // each other
+                if (count && (list[count - 1].address + list[count - 1].size) == (address + (offset - start))) {
+                    list[count - 1].size += (limit - offset);
+                }
+                else {
+                    // check if the list of the host is full
+                    if (count >= max) {
+                        return -1;
+                    }
+
+                    list[count++] = {
+                        .address = address + (offset - start),
+                        .size = (limit - offset)
+                    };
+                }
+            }
+
+            scope.advance(limit - offset);
+
+            offset = limit;
+        }
+
+        return count;
+    }
+#endif
+
+#if PROGRAM_BATCH
+    /**
+     * @brief State of a batch program. The erase of the batch is planned over
+     * all the regions at once. Every erase unit is erased right before the 
+     * first critical region in it is programmed, the units without critical 
+     * regions are erased after all the critical regions are done. This uses 
+     * the same erase commands as a single erase of the whole batch and never
+     * erases a unit twice
+     * 
+     */
+    namespace batch {
+        // list of the host
+        static inline const batch_region *list = nullptr;
+        static inline uint32_t count = 0;
+
+        // index of the critical region the units are erased for. Count for 
+        // the units without critical regions
+        static inline uint32_t owner = 0;
+
+        /**
+         * @brief Get the sectors a region is in
+         * 
+         * @param region 
+         * @param start offset of the first sector
+         * @param end offset after the last sector
+         * @return true when the region is not empty and on the device
+         */
+        static bool span(const batch_region& region, uint32_t& start, uint32_t& end) {
+            const uint32_t offset = (region.address & 0xfffffff);
+
+            if (!region.size || (offset + region.size) < offset) {
+                return false;
+            }
+
+            // get the sectors of the first and the last byte
+            const geometry::region *const first = geometry::table::find(offset);
+            const geometry::region *const last = geometry::table::find(offset + region.size - 1);
+
+            if (first == nullptr || last == nullptr) {
+                return false;
+            }
+
+            start = offset & ~((0x1 << first->shift) - 1);
+            end = ((offset + region.size - 1) & ~((0x1 << last->shift) - 1)) + (0x1 << last->shift);
+
+            return true;
+        }
+
+        /**
+         * @brief Get the next range of sectors to erase. Regions that overlap
+         * or are next to each other are merged, in any order of the list, so
+         * the erase can use the larger erase units
+         * 
+         * @param from offset after the previous range
+         * @param start offset of the first sector
+         * @param end offset after the last sector
+         * @return true when there is a range
+         */
+        static bool next_range(const uint32_t from, uint32_t& start, uint32_t& end) {
+            bool found = false;
+
+            // get the first region after the previous range
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t s;
+                uint32_t e;
+
+                if (span(list[i], s, e) && s >= from && (!found || s < start)) {
+                    start = s;
+                    end = e;
+                    found = true;
+                }
+            }
+
+            // add every region that starts in the range until nothing changes
+            for (bool changed = found; changed;) {
+                changed = false;
+
+                for (uint32_t i = 0; i < count; i++) {
+                    uint32_t s;
+                    uint32_t e;
+
+                    if (span(list[i], s, e) && s >= start && s <= end && e > end) {
+                        end = e;
+                        changed = true;
+                    }
+                }
+            }
+
+            return found;
+        }
+
+        /**
+         * @brief Returns if a erase unit should be erased for the current 
+         * owner
+         * 
+         * @param offset 
+         * @param size 
+         * @return true when the first critical region in the unit is the 
+         * owner
+         */
+        static bool selected(const uint32_t offset, const uint32_t size) {
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t s;
+                uint32_t e;
+
+                if (list[i].critical && span(list[i], s, e) && s < (offset + size) && e > offset) {
+                    return i == owner;
+                }
+            }
+
+            return owner == count;
+        }
+
+        /**
+         * @brief Erase the units of the current owner
+         * 
+         * @return int 0 = OK, 1 = Failed
+         */
+        static int erase() {
+            uint32_t start;
+            uint32_t end;
+
+            for (uint32_t from = 0; next_range(from, start, end); from = end) {
+                if (erase_range(start, end, selected)) {
+                    return 1;
+                }
+            }
+
+            return 0;
+        }
+    }
+
+    int __attribute__ ((noinline, __used__)) ProgramBatch(const batch_region *const list, const uint32_t count) {
+        batch::list = list;
+        batch::count = count;
+
+        // total of the erases, programs and crc checks
+        uint32_t total = 0;
+
+        // check the list before anything is changed on the device
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t start;
+            uint32_t end;
+
+            if (!batch::span(list[i], start, end) || (list[i].address & ((0x1 << PAGE_SIZE_SHIFT) - 1))) {
+                return 1;
+            }
+
+            // regions may share a sector but not a byte. The bytes of 
+            // both regions would be programmed without a erase between
+            for (uint32_t j = 0; j < i; j++) {
+                const uint32_t a = (list[i].address & 0xfffffff);
+                const uint32_t b = (list[j].address & 0xfffffff);
+
+                if (a < (b + list[j].size) && b < (a + list[i].size)) {
+                    return 1;
+                }
+            }
+
+            total += list[i].critical ? (list[i].size * 2) : list[i].size;
+        }
+
+        uint32_t start;
+        uint32_t end;
+
+        for (uint32_t from = 0; batch::next_range(from, start, end); from = end) {
+            total += (end - start);
+        }
+
+        call_scope scope(progress::operation::batch, total);
+
+        // erase, program and check the critical regions in the order of 
+        // the list. A region is done before the next one starts
+        for (uint32_t i = 0; i < count; i++) {
+            if (!list[i].critical) {
+                continue;
+            }
+
+            batch::owner = i;
+
+            if (batch::erase()) {
+                return 1;
+            }
+
+            if (program_range(list[i].address, list[i].size, list[i].data)) {
+                return 1;
+            }
+
+            crc32 result(0xedb88320, 0xffffffff);
+
+            read_crc(result, list[i].address, list[i].size);
+
+            if (~result.get() != list[i].crc) {
+                return 2;
+            }
+        }
+
+        // erase the rest of the batch and program the bulk regions
+        batch::owner = count;
+
+        if (batch::erase()) {
+            return 1;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (list[i].critical) {
+                continue;
+            }
+
+            if (program_range(list[i].address, list[i].size, list[i].data)) {
+                return 1;
+            }
         }
 
         return 0;
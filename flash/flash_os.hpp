@@ -8,7 +8,7 @@ constexpr static uint16_t flash_drv_version = 0x101;
 
 // max amount of sectors in the flash device. Can be modified
 // to allow more sectors in the flash device
-constexpr static uint32_t max_sectors = 4;
+constexpr static uint32_t max_sectors = 8;
 
 // max amount of sectors in the flash info. Should not be 
 // modified as the j-link software only supports up to 7
@@ -117,6 +117,58 @@ struct flash_info {
     info::flash_sector sectors[max_info_sectors];
 };
 
+/**
+ * @brief Result of a dry-run estimate
+ * 
+ */
+struct estimate {
+    // bytes that go over the spi bus
+    uint32_t bus_bytes;
+
+    // amount of spi transactions
+    uint32_t commands;
+
+    // typical time the device is busy in microseconds
+    uint32_t busy_time;
+
+    // bytes of the range that are already blank
+    uint32_t blank;
+};
+
+/**
+ * @brief Range of the device that is not blank
+ * 
+ */
+struct extent {
+    // address of the first byte
+    uint32_t address;
+
+    // size in bytes
+    uint32_t size;
+};
+
+/**
+ * @brief Region of a batch program
+ * 
+ */
+struct batch_region {
+    // address of the first byte. Should be at the start of a page
+    uint32_t address;
+
+    // size in bytes
+    uint32_t size;
+
+    // data to program in the ram of the target
+    const uint8_t *data;
+
+    // 1 = critical. Critical regions are erased, programmed and checked
+    // one by one before the bulk regions
+    uint32_t critical;
+
+    // crc-32 of the data. Only checked for critical regions
+    uint32_t crc;
+};
+
 /**
  * @brief Extern C as the Segger application is only searching the 
  * elf for C functions. This prevents a error popup.
@@ -136,7 +188,7 @@ extern "C" {
      * @param Addr Address to init
      * @param Freq Clock frequency (Hz) 
      * @param Func function code. (1 - Erase, 2 = Program, 3 = Verify)
-     * @return int 0 = OK, 1 = Failed
+     * @return int 0 = OK, 1 = Failed, 2 = No device answered
      */
     int Init(const uint32_t address, const uint32_t frequency, const uint32_t function);
 
@@ -211,6 +263,18 @@ extern "C" {
      */
     void FeedWatchdog();
 
+    /**
+     * @brief Calculate the crc of a range in flash memory. Used by J-Link
+     * to compare the flash with the data to program
+     * 
+     * @param CRC start value
+     * @param Addr 
+     * @param NumBytes 
+     * @param Polynom reflected polynomial
+     * @return uint32_t crc of the range
+     */
+    uint32_t SEGGER_OPEN_CalcCRC(uint32_t crc, uint32_t address, uint32_t size, uint32_t polynomial);
+
     /**
      * @brief Read from memory. Necessary if flash is not memory mapped 
      * 
@@ -249,6 +313,73 @@ extern "C" {
      * @return int 
      */
     int SEGGER_OPEN_GetFlashInfo(flash_info *const info, uint32_t InfoAreaSize);
+
+    /**
+     * @brief Loader extensions. These are not called by the J-Link software. 
+     * The host can call them using the addresses in OFL_Extension_Api
+     * 
+     */
+
+    /**
+     * @brief Calculate the sha-256 of a range in flash memory
+     * 
+     * @param Addr 
+     * @param NumBytes 
+     * @param pDigest 32 byte buffer for the digest
+     * @return int 0 = OK, 1 = Failed
+     */
+    int HashRange(const uint32_t address, const uint32_t size, uint8_t *const digest);
+
+    /**
+     * @brief Estimate the cost of a operation without changing the flash. 
+     * Runs the same planning as the operation and checks which parts are 
+     * already blank
+     * 
+     * @param Func 1 = Erase, 2 = Program, 3 = Blank check, 4 = Chip erase
+     * @param Addr 
+     * @param NumBytes 
+     * @param pResult 
+     * @return int 0 = OK, 1 = Failed
+     */
+    int Estimate(const uint32_t function, const uint32_t address, const uint32_t size, estimate *const result);
+
+    /**
+     * @brief Read a range of flash memory and write it compressed to the 
+     * buffer of the host. See dump.hpp for the format
+     * 
+     * @param Addr 
+     * @param NumBytes 
+     * @param pDest 
+     * @param DestSize should fit the worst case of NumBytes
+     * @return int >= 0 = amount of compressed bytes, < 0 = Failed
+     */
+    int Dump(const uint32_t address, const uint32_t size, uint8_t *const data, const uint32_t capacity);
+
+    /**
+     * @brief Scan a range and write every part that is not blank to the 
+     * list of the host. Works per sector, sectors next to each other are 
+     * merged in a single extent
+     * 
+     * @param Addr 
+     * @param NumBytes 
+     * @param pList 
+     * @param MaxExtents 
+     * @return int >= 0 = amount of extents, < 0 = Failed or the list is full
+     */
+    int Extents(const uint32_t address, const uint32_t size, extent *const list, const uint32_t max);
+
+    /**
+     * @brief Program a list of regions. The critical regions are erased,
+     * programmed and checked against their crc first, in the order of 
+     * the list. The bulk regions are erased and programmed after that. 
+     * The erase is planned over the whole list
+     * 
+     * @param pList 
+     * @param NumRegions 
+     * @return int 0 = OK, 1 = Failed, 2 = Crc of a critical region does 
+     * not match
+     */
+    int ProgramBatch(const batch_region *const list, const uint32_t count);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,269 @@
+#ifndef FLASH_GEOMETRY_HPP
+#define FLASH_GEOMETRY_HPP
+
+#include <cstdint>
+
+#include "flash_os.hpp"
+
+namespace geometry {
+    /**
+     * @brief Region with sectors of the same size
+     * 
+     */
+    struct region {
+        // offset of the first sector in the region
+        uint32_t start;
+
+        // offset after the last sector in the region
+        uint32_t end;
+
+        // index of the first sector in the region
+        uint32_t index;
+
+        // sector size in the region. <SectorSize> = 2 ^ shift
+        uint8_t shift;
+    };
+
+    /**
+     * @brief Sector layout of the device. Built from a sector list at
+     * runtime and used to go from a address or sector index to the
+     * region it is in.
+     * 
+     */
+    class table {
+    protected:
+        // all the regions of the device
+        static inline region regions[max_sectors] = {};
+
+        // amount of valid regions
+        static inline uint32_t count = 0;
+
+        // index of the region that matched the last lookup. Most lookups
+        // are sequential so this is checked first
+        static inline uint32_t last = 0;
+
+        /**
+         * @brief Get the shift of a power of 2 size. Returns 0 when
+         * the size is not a power of 2
+         * 
+         * @param size
+         * @return uint8_t
+         */
+        constexpr static uint8_t log2(const uint32_t size) {
+            if (!size || (size & (size - 1))) {
+                return 0;
+            }
+
+            uint8_t shift = 0;
+
+            while ((0x1u << shift) != size) {
+                shift++;
+            }
+
+            return shift;
+        }
+
+    public:
+        /**
+         * @brief Build the table from a sector list that is terminated
+         * with a end of sectors marker (the flash device format). Every
+         * entry continues until the offset of the next entry or the end
+         * of the device.
+         * 
+         * @param sectors
+         * @param size size of the device
+         * @return true when the list is valid
+         */
+        static bool build(const device::flash_sector *const sectors, const uint32_t size) {
+            count = 0;
+            last = 0;
+
+            uint32_t index = 0;
+
+            for (uint32_t i = 0; i < max_sectors; i++) {
+                // check if we are at the end of the list
+                if (sectors[i].size == device::end_of_sectors.size) {
+                    break;
+                }
+
+                // get the end of this region
+                const uint32_t end = (
+                    ((i + 1) < max_sectors && sectors[i + 1].size != device::end_of_sectors.size) ?
+                    sectors[i + 1].offset : size
+                );
+
+                const uint8_t shift = log2(sectors[i].size);
+
+                // only allow power of 2 sectors that fit the region
+                if (!shift || end <= sectors[i].offset ||
+                    (sectors[i].offset & (sectors[i].size - 1)) ||
+                    ((end - sectors[i].offset) & (sectors[i].size - 1)))
+                {
+                    count = 0;
+                    return false;
+                }
+
+                regions[count++] = {
+                    .start = sectors[i].offset,
+                    .end = end,
+                    .index = index,
+                    .shift = shift
+                };
+
+                index += (end - sectors[i].offset) >> shift;
+            }
+
+            return count != 0;
+        }
+
+        /**
+         * @brief Find the region a offset is in
+         * 
+         * @param offset
+         * @return const region* nullptr when the offset is outside the device
+         */
+        static const region* find(const uint32_t offset) {
+            // check the region of the last lookup first
+            if (count && offset >= regions[last].start && offset < regions[last].end) {
+                return &regions[last];
+            }
+
+            for (uint32_t i = 0; i < count; i++) {
+                if (offset >= regions[i].start && offset < regions[i].end) {
+                    last = i;
+                    return &regions[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        /**
+         * @brief Get the amount of regions in the table
+         * 
+         * @return uint32_t 
+         */
+        static uint32_t size() {
+            return count;
+        }
+
+        /**
+         * @brief Get a region by its index
+         * 
+         * @param index
+         * @return const region& 
+         */
+        static const region& at(const uint32_t index) {
+            return regions[index];
+        }
+
+        /**
+         * @brief Get the offset of a sector index. The index directly after
+         * the last sector returns the size of the device
+         * 
+         * @param index
+         * @param offset
+         * @return true when the index is valid
+         */
+        static bool offset(const uint32_t index, uint32_t& offset) {
+            for (uint32_t i = 0; i < count; i++) {
+                // amount of sectors in the region
+                const uint32_t sectors = (regions[i].end - regions[i].start) >> regions[i].shift;
+
+                if (index <= (regions[i].index + sectors)) {
+                    offset = regions[i].start + ((index - regions[i].index) << regions[i].shift);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    };
+
+    /**
+     * @brief Splits a sector aligned range in the least amount of erase
+     * commands without crossing a region boundary. Erase units should
+     * be sorted from the largest to the smallest.
+     * 
+     * @tparam Units amount of erase units of the device
+     */
+    template <uint32_t Units>
+    class planner {
+    protected:
+        // erase units of the device. <UnitSize> = 2 ^ shift
+        const uint8_t (&shifts)[Units];
+
+        // next offset to erase
+        uint32_t current;
+
+        // end of the range to erase
+        const uint32_t end;
+
+    public:
+        /**
+         * @brief Step in the erase plan
+         * 
+         */
+        struct step {
+            // offset to erase
+            uint32_t offset;
+
+            // index of the erase unit to use
+            uint32_t unit;
+        };
+
+        planner(const uint8_t (&shifts)[Units], const uint32_t start, const uint32_t end):
+            shifts(shifts), current(start), end(end)
+        {}
+
+        /**
+         * @brief Get the next erase command
+         * 
+         * @param s
+         * @return true when s has a new command. False when the
+         * range is done or is not aligned to the sectors of the device
+         */
+        bool next(step& s) {
+            if (current >= end) {
+                return false;
+            }
+
+            const region *const r = table::find(current);
+
+            // check if the offset is in the device and aligned to a sector
+            if (r == nullptr || (current & ((0x1u << r->shift) - 1))) {
+                return false;
+            }
+
+            // never erase past the range or the region
+            const uint32_t limit = (end < r->end) ? end : r->end;
+
+            for (uint32_t i = 0; i < Units; i++) {
+                const uint32_t size = (0x1u << shifts[i]);
+
+                // check if the unit is aligned and fits
+                if ((current & (size - 1)) || ((current + size) > limit)) {
+                    continue;
+                }
+
+                s = {current, i};
+                current += size;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        /**
+         * @brief Returns if the whole range is planned
+         * 
+         * @return true
+         */
+        bool done() const {
+            return current >= end;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef FLASH_HARDWARE_HPP
+#define FLASH_HARDWARE_HPP
+
+#include <cstdint>
+
+#include <klib/klib.hpp>
+#include <io/pins.hpp>
+#include <io/spi.hpp>
+
+#include "chips.hpp"
+#include "fast_pin.hpp"
+#include "spi_nor.hpp"
+#include "ssp.hpp"
+#include "quad.hpp"
+
+namespace target = klib::target;
+
+// pins of the package of the cpu. Set by cmake. Only the lqfp80 and 
+// lqfp100 pins are mapped below, cmake rejects the parts in other packages
+namespace package = target::pins::package::TARGET_PACKAGE;
+namespace periph = target::io::periph::TARGET_PACKAGE;
+
+// cpu frequency set in Init
+constexpr static uint32_t cpu_frequency = 96'000'000;
+
+// pins of the chip select and the quad data phase. IO0, IO1 and the 
+// clock are the pins of spi0. The chip select, IO2 (WP#) and IO3 (HOLD#)
+// depend on the board and should be changed to the pins the device is 
+// connected to
+#if defined(TARGET_PACKAGE_lqfp_80)
+    using cs_pin = package::p50;
+    using sck_pin = package::p47;
+    using io0_pin = package::p45;
+    using io1_pin = package::p46;
+    using io2_pin = package::p51;
+    using io3_pin = package::p52;
+#elif defined(TARGET_PACKAGE_lqfp_100)
+    // spi0 is on P0.15 (clock), P0.17 (IO1) and P0.18 (IO0). The chip 
+    // select uses SSEL0 (P0.16) as gpio. IO2 and IO3 are on P0.22 and 
+    // P0.21 as all the quad pins should be on the port of the clock
+    using cs_pin = package::p63;
+    using sck_pin = package::p62;
+    using io0_pin = package::p60;
+    using io1_pin = package::p61;
+    using io2_pin = package::p56;
+    using io3_pin = package::p57;
+#else
+    #error "flash/hardware.hpp has no pins for the package of the cpu"
+#endif
+
+// chip select using the fast gpio registers. The minimum high and hold 
+// times are rounded up to full cpu cycles. Uses the longest times of all
+// the parts as the pin is setup before the device is known
+using cs = fast_pin_out<
+    cs_pin, ((chips::unknown.timing.cs_high * (cpu_frequency / 1'000'000)) + 999) / 1000,
+    ((chips::unknown.timing.cs_hold * (cpu_frequency / 1'000'000)) + 999) / 1000
+>;
+
+using spi = target::io::spi<periph::spi0>;
+// receive path of ssp0. The peripheral of spi0
+using stream = ssp_stream<0x40088000>;
+
+using nor = spi_nor<spi, cs, stream>;
+
+using quad = quad_program<nor, spi, cs, sck_pin, io0_pin, io1_pin, io2_pin, io3_pin>;
+
+#endif
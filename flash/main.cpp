@@ -1,6 +1,24 @@
 #include <cstdint>
 
 #include "flash_os.hpp"
+#include "cycles.hpp"
+#include "hardware.hpp"
+
+/**
+ * @brief Cycles of a single chip select low/high toggle. Filled in by
+ * the debug code. Can be read with the debugger and passed to
+ * "benchmark.py cs" on the host.
+ * 
+ */
+struct cs_measurement {
+    // cycles using the generic klib pin
+    uint32_t generic;
+
+    // cycles using the chip select of the loader (fast gpio pin)
+    uint32_t fast;
+};
+
+volatile cs_measurement CsMeasurement __attribute__ ((__used__));
 
 int main() {
     // flag to mark if we want to run the test code
@@ -12,6 +30,33 @@ int main() {
         return 0;
     }
 
+    // amount of toggles to average over
+    constexpr static uint32_t toggles = 1024;
+
+    cycles::init();
+    cs::init();
+
+    // measure the generic pin implementation
+    uint32_t start = cycles::get();
+
+    for (uint32_t i = 0; i < toggles; i++) {
+        target::io::pin_out<cs_pin>::set<false>();
+        target::io::pin_out<cs_pin>::set<true>();
+    }
+
+    CsMeasurement.generic = (cycles::get() - start) / toggles;
+
+    // measure the chip select the loader uses. Includes the hold and 
+    // minimum high time it enforces
+    start = cycles::get();
+
+    for (uint32_t i = 0; i < toggles; i++) {
+        cs::set<false>();
+        cs::set<true>();
+    }
+
+    CsMeasurement.fast = (cycles::get() - start) / toggles;
+
     // TODO: add a example here to test the flash algorithm
 
     return 0;
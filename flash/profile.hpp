@@ -0,0 +1,187 @@
+#ifndef FLASH_PROFILE_HPP
+#define FLASH_PROFILE_HPP
+
+#include <cstdint>
+
+namespace profile {
+    // amount of buckets in the histogram
+    constexpr static uint32_t size = 512;
+
+    // smallest bucket size. <BucketSize> = 2 ^ min_shift
+    constexpr static uint32_t min_shift = 2;
+
+    /**
+     * @brief Histogram of the sampled program counters
+     * 
+     */
+    struct histogram {
+        // first address and the bucket size of the histogram. Set so
+        // the host does not need to know the layout
+        uint32_t base;
+        uint32_t shift;
+
+        // amount of samples taken
+        uint32_t samples;
+
+        // samples with a program counter outside the histogram
+        uint32_t outside;
+
+        // samples per bucket. Saturates at the maximum value
+        uint16_t counts[size];
+    };
+}
+
+extern "C" {
+    // histogram of the loader. Only exists when profiling is enabled
+    extern volatile profile::histogram LoaderProfile;
+
+    // start of the vector table of the loader. Definition is done in the 
+    // linkerscript
+    extern const uint32_t __vectors_start;
+
+    // start and end of the code of the loader (the flash os information
+    // up to the end of the text segment). Definition is done in the 
+    // linkerscript
+    extern const uint32_t __code_start;
+    extern const uint32_t __code_end;
+}
+
+namespace profile {
+    /**
+     * @brief Get the first address of the histogram
+     * 
+     * @return uint32_t 
+     */
+    static inline uint32_t base() {
+        return reinterpret_cast<uint32_t>(&__code_start);
+    }
+
+    /**
+     * @brief Get the smallest bucket size so the histogram covers all 
+     * the code of the loader. <BucketSize> = 2 ^ shift
+     * 
+     * @return uint32_t 
+     */
+    static inline uint32_t shift() {
+        const uint32_t length = reinterpret_cast<uint32_t>(&__code_end) - base();
+
+        uint32_t result = min_shift;
+
+        while ((size << result) < length) {
+            result++;
+        }
+
+        return result;
+    }
+}
+
+namespace profile {
+    /**
+     * @brief Add a sampled program counter to the histogram
+     * 
+     * @param pc
+     */
+    static inline void sample(const uint32_t pc) {
+        LoaderProfile.samples = LoaderProfile.samples + 1;
+
+        const uint32_t bucket = (pc - LoaderProfile.base) >> LoaderProfile.shift;
+
+        if (bucket >= size) {
+            LoaderProfile.outside = LoaderProfile.outside + 1;
+            return;
+        }
+
+        if (LoaderProfile.counts[bucket] != 0xffff) {
+            LoaderProfile.counts[bucket] = LoaderProfile.counts[bucket] + 1;
+        }
+    }
+
+    /**
+     * @brief Samples the program counter with the SysTick interrupt. The
+     * vector table of the loader is used while the sampler is running.
+     * Does nothing when it is not enabled so the calls can stay in the
+     * code
+     * 
+     * @tparam Enabled
+     * @tparam Interval cpu cycles between samples
+     */
+    template <bool Enabled, uint32_t Interval>
+    class sampler {
+    protected:
+        // vector table offset register
+        static inline volatile uint32_t *const vtor = reinterpret_cast<volatile uint32_t*>(0xe000ed08);
+
+        // system handler priority register 3. Has the SysTick priority
+        static inline volatile uint32_t *const shpr3 = reinterpret_cast<volatile uint32_t*>(0xe000ed20);
+
+        // SysTick control, reload and current value registers
+        static inline volatile uint32_t *const control = reinterpret_cast<volatile uint32_t*>(0xe000e010);
+        static inline volatile uint32_t *const reload = reinterpret_cast<volatile uint32_t*>(0xe000e014);
+        static inline volatile uint32_t *const current = reinterpret_cast<volatile uint32_t*>(0xe000e018);
+
+        // state to restore when the sampler stops
+        static inline uint32_t table = 0;
+        static inline uint32_t primask = 0;
+
+        static_assert(Interval > 0 && Interval <= 0x1000000, "SysTick reload out of range");
+
+    public:
+        /**
+         * @brief Start sampling
+         * 
+         */
+        static void start() {
+            if constexpr (Enabled) {
+                // the histogram is not initialized when the loader is
+                // downloaded
+                const uint32_t first = base();
+                const uint32_t bucket = shift();
+
+                if (LoaderProfile.base != first || LoaderProfile.shift != bucket) {
+                    for (uint32_t i = 0; i < size; i++) {
+                        LoaderProfile.counts[i] = 0;
+                    }
+
+                    LoaderProfile.samples = 0;
+                    LoaderProfile.outside = 0;
+                    LoaderProfile.base = first;
+                    LoaderProfile.shift = bucket;
+                }
+
+                // use the vector table of the loader
+                table = (*vtor);
+                (*vtor) = reinterpret_cast<uint32_t>(&__vectors_start);
+
+                // give SysTick the highest priority
+                (*shpr3) &= ~(0xff << 24);
+
+                (*reload) = Interval - 1;
+                (*current) = 0;
+
+                // use the cpu clock and enable the interrupt
+                (*control) = (0x1 << 2) | (0x1 << 1) | 0x1;
+
+                // enable the interrupts. J-Link resets the target before
+                // the loader runs so no other interrupts are enabled
+                asm volatile ("mrs %0, primask" : "=r" (primask));
+                asm volatile ("cpsie i" ::: "memory");
+            }
+        }
+
+        /**
+         * @brief Stop sampling and restore the state from before start
+         * 
+         */
+        static void stop() {
+            if constexpr (Enabled) {
+                (*control) = 0;
+
+                asm volatile ("msr primask, %0" :: "r" (primask) : "memory");
+
+                (*vtor) = table;
+            }
+        }
+    };
+}
+
+#endif
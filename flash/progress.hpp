@@ -0,0 +1,114 @@
+#ifndef FLASH_PROGRESS_HPP
+#define FLASH_PROGRESS_HPP
+
+#include <cstdint>
+
+#include "cycles.hpp"
+
+namespace progress {
+    /**
+     * @brief Operation the loader is running
+     * 
+     */
+    enum class operation: uint32_t {
+        idle = 0,
+        init = 1,
+        erase = 2,
+        erase_chip = 3,
+        program = 4,
+        blank_check = 5,
+        read = 6,
+        hash = 7,
+        estimate = 8,
+        dump = 9,
+        extents = 10,
+        verify = 11,
+        crc = 12,
+        batch = 13,
+    };
+
+    /**
+     * @brief Progress record. Placed at a fixed address at the end of the 
+     * ram so the host can read it using the memory access port while the 
+     * loader is running.
+     * 
+     */
+    struct record {
+        // operation that is running
+        operation current;
+
+        // amount of bytes that are done
+        uint32_t done;
+
+        // total amount of bytes of the operation
+        uint32_t total;
+
+        // cycle count when the loader last polled the device. Changes 
+        // as long as the loader is alive
+        uint32_t timestamp;
+    };
+}
+
+extern "C" {
+    // progress record of the loader. Address is fixed by the linkerscript
+    extern volatile progress::record LoaderProgress;
+}
+
+namespace progress {
+    /**
+     * @brief Updates the progress record for a operation. Only the 
+     * outermost scope changes the operation. This makes sure calls 
+     * that use other ramcode functions (e.g. SEGGER_OPEN_Program calling
+     * ProgramPage) keep reporting the operation that was started.
+     * 
+     */
+    class scope {
+    protected:
+        // flag if this scope started the operation
+        const bool owner;
+
+    public:
+        scope(const operation op, const uint32_t total):
+            owner(LoaderProgress.current == operation::idle)
+        {
+            if (!owner) {
+                return;
+            }
+
+            LoaderProgress.done = 0;
+            LoaderProgress.total = total;
+            LoaderProgress.timestamp = cycles::get();
+
+            // set the operation as the last item so the host sees a 
+            // consistent record
+            LoaderProgress.current = op;
+        }
+
+        ~scope() {
+            if (owner) {
+                LoaderProgress.current = operation::idle;
+            }
+        }
+
+        /**
+         * @brief Mark a amount of bytes as done
+         * 
+         * @param bytes 
+         */
+        static void advance(const uint32_t bytes) {
+            LoaderProgress.done = LoaderProgress.done + bytes;
+            LoaderProgress.timestamp = cycles::get();
+        }
+
+        /**
+         * @brief Mark the loader is still alive while waiting on the 
+         * device
+         * 
+         */
+        static void poll() {
+            LoaderProgress.timestamp = cycles::get();
+        }
+    };
+}
+
+#endif
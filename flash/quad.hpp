@@ -0,0 +1,213 @@
+#ifndef FLASH_QUAD_HPP
+#define FLASH_QUAD_HPP
+
+#include <cstdint>
+
+#include <io/pins.hpp>
+
+#include "state.hpp"
+
+/**
+ * @brief Quad input page program (0x32) for spi nor flash on the lpc17xx.
+ * The opcode and address are send using the spi bus. The data is clocked
+ * on IO0-IO3 by writing the fast gpio pin register with all the other
+ * pins of the port masked.
+ * 
+ * @details the spi pins are switched to gpio for the data phase and
+ * switched back to the function they had after. IO2 and IO3 (WP# and
+ * HOLD#) are gpio outputs that are kept high outside the data phase.
+ * The write enables and status register writes go through the spi nor 
+ * class so the chip_state model sees them.
+ * 
+ * @tparam Nor spi nor commands of the device
+ * @tparam Bus
+ * @tparam Cs
+ * @tparam Sck
+ * @tparam Io0 MOSI of the spi bus
+ * @tparam Io1 MISO of the spi bus
+ * @tparam Io2
+ * @tparam Io3
+ */
+template <
+    typename Nor, typename Bus, typename Cs, typename Sck,
+    typename Io0, typename Io1, typename Io2, typename Io3
+>
+class quad_program {
+protected:
+    static_assert(
+        Sck::port::id == Io0::port::id && Sck::port::id == Io1::port::id &&
+        Sck::port::id == Io2::port::id && Sck::port::id == Io3::port::id,
+        "All the quad pins should be on the same port"
+    );
+
+    // base address of the fast gpio port of the pins
+    constexpr static uint32_t base = 0x2009c000 + (Sck::port::id * 0x20);
+
+    // fast gpio registers of the port
+    static inline volatile uint32_t *const fiodir = reinterpret_cast<volatile uint32_t*>(base + 0x00);
+    static inline volatile uint32_t *const fiomask = reinterpret_cast<volatile uint32_t*>(base + 0x10);
+    static inline volatile uint32_t *const fiopin = reinterpret_cast<volatile uint32_t*>(base + 0x14);
+
+    // mask of the clock pin
+    constexpr static uint32_t sck = (0x1u << Sck::number);
+
+    // mask of the data pins
+    constexpr static uint32_t io = (
+        (0x1u << Io0::number) | (0x1u << Io1::number) |
+        (0x1u << Io2::number) | (0x1u << Io3::number)
+    );
+
+    /**
+     * @brief Pin function select register and shift of a pin
+     * 
+     * @tparam Pin
+     */
+    template <typename Pin>
+    struct pinsel {
+        // PINSEL0 has pin 0 - 15 of port 0, PINSEL1 pin 16 - 31, etc
+        static inline volatile uint32_t *const reg = reinterpret_cast<volatile uint32_t*>(
+            0x4002c000 + (((Pin::port::id * 2) + (Pin::number >= 16)) * 4)
+        );
+
+        constexpr static uint32_t shift = (Pin::number % 16) * 2;
+    };
+
+    /**
+     * @brief Port values of every nibble. IO0 has the lowest bit
+     * 
+     */
+    constexpr static struct nibbles {
+        uint32_t value[16];
+
+        constexpr nibbles(): value{} {
+            for (uint32_t i = 0; i < 16; i++) {
+                value[i] = (
+                    ((i & 0x1) ? (0x1u << Io0::number) : 0) |
+                    ((i & 0x2) ? (0x1u << Io1::number) : 0) |
+                    ((i & 0x4) ? (0x1u << Io2::number) : 0) |
+                    ((i & 0x8) ? (0x1u << Io3::number) : 0)
+                );
+            }
+        }
+    } lookup = {};
+
+    // quad input page program opcode
+    constexpr static uint8_t quad_program_opcode = 0x32;
+
+    // flag if the quad enable bit was set before enable was called
+    static inline bool was_enabled = false;
+
+public:
+    /**
+     * @brief Init IO2 and IO3 as outputs that are high
+     * 
+     */
+    static void init() {
+        klib::target::io::pin_out<Io2>::init();
+        klib::target::io::pin_out<Io3>::init();
+
+        klib::target::io::pin_out<Io2>::template set<true>();
+        klib::target::io::pin_out<Io3>::template set<true>();
+    }
+
+    /**
+     * @brief Set the quad enable bit. The bit is non volatile so the
+     * previous value is restored in disable. The caller should wait
+     * until the device is not busy
+     * 
+     * @param typical cpu cycles the status write typically takes
+     */
+    static void enable(const uint32_t typical) {
+        const uint8_t value = Nor::status();
+
+        was_enabled = (value & chip_state::qe);
+
+        if (!was_enabled) {
+            Nor::write_status(value | chip_state::qe, typical);
+        }
+    }
+
+    /**
+     * @brief Restore the quad enable bit to the value it had before
+     * enable. The caller should wait until the device is not busy
+     * 
+     * @param typical cpu cycles the status write typically takes
+     */
+    static void disable(const uint32_t typical) {
+        if (!was_enabled) {
+            Nor::write_status(Nor::status() & ~chip_state::qe, typical);
+        }
+    }
+
+    /**
+     * @brief Program a page. The caller should wait until the device
+     * is not busy
+     * 
+     * @param address
+     * @param data
+     * @param size should not cross a page
+     * @param typical cpu cycles the program typically takes
+     */
+    static void write(const uint32_t address, const uint8_t *const data, const uint32_t size, const uint32_t typical) {
+        Nor::write_enable();
+
+        const uint8_t header[] = {
+            quad_program_opcode,
+            static_cast<uint8_t>(address >> 16),
+            static_cast<uint8_t>(address >> 8),
+            static_cast<uint8_t>(address)
+        };
+
+        Cs::template set<false>();
+        Bus::write(header);
+
+        // save the state of the port
+        const uint32_t direction = (*fiodir);
+        const uint32_t mask = (*fiomask);
+
+        // only allow writes to the quad pins. Start with the clock high
+        // as the spi bus runs in mode 3
+        (*fiomask) = ~(sck | io);
+        (*fiopin) = sck | io;
+        (*fiodir) = direction | sck | io;
+
+        // switch the spi pins to gpio
+        const uint32_t sck_function = (*pinsel<Sck>::reg) & (0x3 << pinsel<Sck>::shift);
+        const uint32_t io0_function = (*pinsel<Io0>::reg) & (0x3 << pinsel<Io0>::shift);
+        const uint32_t io1_function = (*pinsel<Io1>::reg) & (0x3 << pinsel<Io1>::shift);
+
+        (*pinsel<Sck>::reg) &= ~(0x3 << pinsel<Sck>::shift);
+        (*pinsel<Io0>::reg) &= ~(0x3 << pinsel<Io0>::shift);
+        (*pinsel<Io1>::reg) &= ~(0x3 << pinsel<Io1>::shift);
+
+        // clock the data. The device reads the nibble on the rising edge
+        for (uint32_t i = 0; i < size; i++) {
+            const uint32_t high = lookup.value[data[i] >> 4];
+            const uint32_t low = lookup.value[data[i] & 0xf];
+
+            (*fiopin) = high;
+            (*fiopin) = high | sck;
+            (*fiopin) = low;
+            (*fiopin) = low | sck;
+        }
+
+        // switch the pins back to the spi bus. IO2 and IO3 stay high
+        (*fiopin) = sck | io;
+
+        (*pinsel<Sck>::reg) |= sck_function;
+        (*pinsel<Io0>::reg) |= io0_function;
+        (*pinsel<Io1>::reg) |= io1_function;
+
+        (*fiodir) = direction;
+
+        // restore the mask before the chip select is released. The chip
+        // select uses the fast gpio registers as well
+        (*fiomask) = mask;
+
+        Cs::template set<true>();
+
+        chip_state::started(typical);
+    }
+};
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef FLASH_SHA256_HPP
+#define FLASH_SHA256_HPP
+
+#include <cstdint>
+
+/**
+ * @brief Streaming sha-256. The rounds are unrolled 16 at a time so the
+ * working variables stay in registers and the message schedule is a 16
+ * word window that is expanded in place.
+ * 
+ */
+class sha256 {
+protected:
+    // round constants
+    constexpr static uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    // current hash value
+    uint32_t state[8];
+
+    // message schedule window
+    uint32_t w[16];
+
+    // partial block that is not compressed yet
+    uint8_t block[64];
+
+    // total amount of bytes hashed
+    uint32_t length;
+
+    constexpr static uint32_t ror(const uint32_t value, const uint32_t shift) {
+        return (value >> shift) | (value << (32 - shift));
+    }
+
+    /**
+     * @brief Single round. The caller rotates the working variables by
+     * passing them in a different order every round
+     * 
+     */
+    __attribute__((always_inline)) static void round(
+        const uint32_t a, const uint32_t b, const uint32_t c, uint32_t& d,
+        const uint32_t e, const uint32_t f, const uint32_t g, uint32_t& h,
+        const uint32_t kw)
+    {
+        const uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + (g ^ (e & (f ^ g))) + kw;
+        const uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) | (c & (a | b)));
+
+        d += t1;
+        h = t1 + t2;
+    }
+
+    /**
+     * @brief Expand the next word of the message schedule in place
+     * 
+     * @tparam I index in the window
+     */
+    template <uint32_t I>
+    __attribute__((always_inline)) uint32_t expand() {
+        const uint32_t w2 = w[(I + 14) & 15];
+        const uint32_t w15 = w[(I + 1) & 15];
+
+        w[I] += (
+            (ror(w2, 17) ^ ror(w2, 19) ^ (w2 >> 10)) + w[(I + 9) & 15] +
+            (ror(w15, 7) ^ ror(w15, 18) ^ (w15 >> 3))
+        );
+
+        return w[I];
+    }
+
+    /**
+     * @brief 16 rounds using the current message schedule window
+     * 
+     * @tparam Expand if the window should be expanded first
+     */
+    template <bool Expand>
+    __attribute__((always_inline)) void rounds(
+        uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d,
+        uint32_t& e, uint32_t& f, uint32_t& g, uint32_t& h,
+        const uint32_t *const kr)
+    {
+        round(a, b, c, d, e, f, g, h, kr[0] + (Expand ? expand<0>() : w[0]));
+        round(h, a, b, c, d, e, f, g, kr[1] + (Expand ? expand<1>() : w[1]));
+        round(g, h, a, b, c, d, e, f, kr[2] + (Expand ? expand<2>() : w[2]));
+        round(f, g, h, a, b, c, d, e, kr[3] + (Expand ? expand<3>() : w[3]));
+        round(e, f, g, h, a, b, c, d, kr[4] + (Expand ? expand<4>() : w[4]));
+        round(d, e, f, g, h, a, b, c, kr[5] + (Expand ? expand<5>() : w[5]));
+        round(c, d, e, f, g, h, a, b, kr[6] + (Expand ? expand<6>() : w[6]));
+        round(b, c, d, e, f, g, h, a, kr[7] + (Expand ? expand<7>() : w[7]));
+        round(a, b, c, d, e, f, g, h, kr[8] + (Expand ? expand<8>() : w[8]));
+        round(h, a, b, c, d, e, f, g, kr[9] + (Expand ? expand<9>() : w[9]));
+        round(g, h, a, b, c, d, e, f, kr[10] + (Expand ? expand<10>() : w[10]));
+        round(f, g, h, a, b, c, d, e, kr[11] + (Expand ? expand<11>() : w[11]));
+        round(e, f, g, h, a, b, c, d, kr[12] + (Expand ? expand<12>() : w[12]));
+        round(d, e, f, g, h, a, b, c, kr[13] + (Expand ? expand<13>() : w[13]));
+        round(c, d, e, f, g, h, a, b, kr[14] + (Expand ? expand<14>() : w[14]));
+        round(b, c, d, e, f, g, h, a, kr[15] + (Expand ? expand<15>() : w[15]));
+    }
+
+    /**
+     * @brief Compress a single 64 byte block
+     * 
+     * @param data
+     */
+    void compress(const uint8_t *const data) {
+        // load the block as big endian words
+        for (uint32_t i = 0; i < 16; i++) {
+            w[i] = (
+                (static_cast<uint32_t>(data[i * 4]) << 24) |
+                (static_cast<uint32_t>(data[(i * 4) + 1]) << 16) |
+                (static_cast<uint32_t>(data[(i * 4) + 2]) << 8) |
+                data[(i * 4) + 3]
+            );
+        }
+
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+        uint32_t f = state[5];
+        uint32_t g = state[6];
+        uint32_t h = state[7];
+
+        rounds<false>(a, b, c, d, e, f, g, h, &k[0]);
+
+        for (uint32_t i = 16; i < 64; i += 16) {
+            rounds<true>(a, b, c, d, e, f, g, h, &k[i]);
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+public:
+    /**
+     * @brief Start a new hash
+     * 
+     */
+    void init() {
+        state[0] = 0x6a09e667;
+        state[1] = 0xbb67ae85;
+        state[2] = 0x3c6ef372;
+        state[3] = 0xa54ff53a;
+        state[4] = 0x510e527f;
+        state[5] = 0x9b05688c;
+        state[6] = 0x1f83d9ab;
+        state[7] = 0x5be0cd19;
+
+        length = 0;
+    }
+
+    /**
+     * @brief Add data to the hash
+     * 
+     * @param data
+     * @param size
+     */
+    void update(const uint8_t *data, uint32_t size) {
+        uint32_t used = length & 63;
+        length += size;
+
+        // fill up a partial block first
+        if (used) {
+            while (size && used < 64) {
+                block[used++] = *data++;
+                size--;
+            }
+
+            if (used < 64) {
+                return;
+            }
+
+            compress(block);
+        }
+
+        // compress full blocks directly from the data
+        for (; size >= 64; size -= 64, data += 64) {
+            compress(data);
+        }
+
+        // store what is left for the next update
+        for (uint32_t i = 0; i < size; i++) {
+            block[i] = data[i];
+        }
+    }
+
+    /**
+     * @brief Finish the hash and write the 32 byte digest
+     * 
+     * @param digest
+     */
+    void finish(uint8_t *const digest) {
+        // length in bits before the padding
+        const uint32_t bits_high = length >> 29;
+        const uint32_t bits_low = length << 3;
+
+        uint32_t used = length & 63;
+
+        // add the padding marker
+        block[used++] = 0x80;
+
+        // check if the length still fits in this block
+        if (used > 56) {
+            while (used < 64) {
+                block[used++] = 0x00;
+            }
+
+            compress(block);
+            used = 0;
+        }
+
+        while (used < 56) {
+            block[used++] = 0x00;
+        }
+
+        // add the length in bits as a big endian 64 bit value
+        for (uint32_t i = 0; i < 4; i++) {
+            block[56 + i] = static_cast<uint8_t>(bits_high >> (24 - (i * 8)));
+            block[60 + i] = static_cast<uint8_t>(bits_low >> (24 - (i * 8)));
+        }
+
+        compress(block);
+
+        // write the digest as big endian
+        for (uint32_t i = 0; i < 8; i++) {
+            digest[(i * 4)] = static_cast<uint8_t>(state[i] >> 24);
+            digest[(i * 4) + 1] = static_cast<uint8_t>(state[i] >> 16);
+            digest[(i * 4) + 2] = static_cast<uint8_t>(state[i] >> 8);
+            digest[(i * 4) + 3] = static_cast<uint8_t>(state[i]);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef FLASH_SPI_NOR_HPP
+#define FLASH_SPI_NOR_HPP
+
+#include <cstdint>
+
+#include "state.hpp"
+
+/**
+ * @brief Raw commands for spi nor flash. The opcodes that differ between 
+ * parts are passed by the caller. The write enables, status writes and 
+ * status polls go through the chip_state model so the polls with a known
+ * result are not send.
+ * 
+ * @tparam Bus 
+ * @tparam Cs 
+ * @tparam Stream receive path that passes the read data to a sink
+ */
+template <typename Bus, typename Cs, typename Stream>
+class spi_nor {
+public:
+    /**
+     * @brief Commands used by the loader
+     * 
+     */
+    enum class cmd: uint8_t {
+        write_status = 0x01,
+        page_program = 0x02,
+        read = 0x03,
+        read_status = 0x05,
+        write_enable = 0x06,
+        fast_read = 0x0b,
+        block_erase_32k = 0x52,
+        chip_erase = 0xc7,
+        block_erase_64k = 0xd8,
+        jedec_id = 0x9f,
+        release_power_down = 0xab,
+    };
+
+protected:
+    /**
+     * @brief Send the opcode and the 24 bit address of a command. Leaves
+     * the chip select low
+     * 
+     * @param opcode 
+     * @param address 
+     */
+    static void header(const uint8_t opcode, const uint32_t address) {
+        const uint8_t data[] = {
+            opcode, 
+            static_cast<uint8_t>(address >> 16),
+            static_cast<uint8_t>(address >> 8),
+            static_cast<uint8_t>(address)
+        };
+
+        Cs::template set<false>();
+        Bus::write(data);
+    }
+
+    /**
+     * @brief Send the header of a read command. Fast read sends a dummy
+     * byte after the address. Leaves the chip select low
+     * 
+     * @param opcode read or fast read
+     * @param address 
+     */
+    static void read_header(const cmd opcode, const uint32_t address) {
+        header(static_cast<uint8_t>(opcode), address);
+
+        if (opcode == cmd::fast_read) {
+            const uint8_t dummy[] = {0x00};
+
+            Bus::write(dummy);
+        }
+    }
+
+public:
+    /**
+     * @brief Send a single byte command
+     * 
+     * @param command 
+     */
+    static void send(const cmd command) {
+        const uint8_t data[] = {static_cast<uint8_t>(command)};
+
+        Cs::template set<false>();
+        Bus::write(data);
+        Cs::template set<true>();
+    }
+
+    /**
+     * @brief Send a write enable when the latch is not set already
+     * 
+     */
+    static void write_enable() {
+        if (chip_state::needs_write_enable()) {
+            send(cmd::write_enable);
+
+            chip_state::write_enable();
+        }
+    }
+
+    /**
+     * @brief Write the status register. The caller should wait until 
+     * the device is not busy
+     * 
+     * @param value 
+     * @param typical cpu cycles the write typically takes
+     */
+    static void write_status(const uint8_t value, const uint32_t typical) {
+        write_enable();
+
+        const uint8_t data[] = {static_cast<uint8_t>(cmd::write_status), value};
+
+        Cs::template set<false>();
+        Bus::write(data);
+        Cs::template set<true>();
+
+        chip_state::status_written(value, typical);
+    }
+
+    /**
+     * @brief Read the jedec id. Returns the manufacturer id in the 
+     * upper byte and the device id in the lower 2 bytes
+     * 
+     * @return uint32_t 
+     */
+    static uint32_t jedec_id() {
+        const uint8_t tx[] = {static_cast<uint8_t>(cmd::jedec_id), 0x00, 0x00, 0x00};
+        uint8_t rx[sizeof(tx)] = {};
+
+        Cs::template set<false>();
+        Bus::write_read(tx, rx);
+        Cs::template set<true>();
+
+        return (
+            (static_cast<uint32_t>(rx[1]) << 16) | 
+            (static_cast<uint32_t>(rx[2]) << 8) | rx[3]
+        );
+    }
+
+    /**
+     * @brief Returns if a jedec id came from a device. A missing device 
+     * or a device in deep power-down leaves the bus at all zeros or 
+     * all ones
+     * 
+     * @param id 
+     * @return true 
+     */
+    constexpr static bool valid(const uint32_t id) {
+        return id != 0x000000 && id != 0xffffff;
+    }
+
+    /**
+     * @brief Get the size of the device from the capacity byte of the 
+     * jedec id. <Size> = 2 ^ capacity
+     * 
+     * @param id 
+     * @return uint32_t size in bytes. 0 when the capacity is not in the 
+     * range the loader can address. Every command sends a 3 byte address
+     * so parts above 16MB are not supported
+     */
+    constexpr static uint32_t capacity(const uint32_t id) {
+        const uint32_t shift = id & 0xff;
+
+        return (shift >= 16 && shift <= 24) ? (0x1 << shift) : 0;
+    }
+
+    /**
+     * @brief Read the status register
+     * 
+     * @return uint8_t 
+     */
+    static uint8_t status() {
+        const uint8_t tx[] = {static_cast<uint8_t>(cmd::read_status), 0x00};
+        uint8_t rx[sizeof(tx)] = {};
+
+        Cs::template set<false>();
+        Bus::write_read(tx, rx);
+        Cs::template set<true>();
+
+        return rx[1];
+    }
+
+    /**
+     * @brief Read the status register and update the model with it
+     * 
+     * @return true when the device is busy with a program, erase or 
+     * status register write
+     */
+    static bool poll() {
+        const uint8_t value = status();
+
+        chip_state::polled(value);
+
+        return value & chip_state::wip;
+    }
+
+    /**
+     * @brief Returns if the device is busy. Only polls the device when 
+     * the model does not know the answer
+     * 
+     * @return true 
+     */
+    static bool busy() {
+        if (!chip_state::poll_needed()) {
+            return chip_state::busy();
+        }
+
+        return poll();
+    }
+
+    /**
+     * @brief Set the model from the status register. The caller should 
+     * make sure the device is not busy
+     * 
+     */
+    static void sync() {
+        chip_state::sync(status());
+    }
+
+    /**
+     * @brief Clear the continuous read mode. A device in this mode takes
+     * the first byte of a transaction as the mode bits of a read and
+     * ignores every command
+     * 
+     */
+    static void reset_continuous() {
+        const uint8_t data[] = {0xff, 0xff};
+
+        Cs::template set<false>();
+        Bus::write(data);
+        Cs::template set<true>();
+    }
+
+    /**
+     * @brief Erase a sector or block. The caller should wait until the 
+     * device is not busy
+     * 
+     * @param opcode erase command of the unit
+     * @param address 
+     * @param typical cpu cycles the erase typically takes
+     */
+    static void erase(const uint8_t opcode, const uint32_t address, const uint32_t typical) {
+        write_enable();
+
+        header(opcode, address);
+        Cs::template set<true>();
+
+        chip_state::started(typical);
+    }
+
+    /**
+     * @brief Erase the whole device. The caller should wait until the 
+     * device is not busy
+     * 
+     * @param typical cpu cycles the erase typically takes
+     */
+    static void chip_erase(const uint32_t typical) {
+        write_enable();
+        send(cmd::chip_erase);
+
+        chip_state::started(typical);
+    }
+
+    /**
+     * @brief Program a page. The caller should wait until the device 
+     * is not busy
+     * 
+     * @param address 
+     * @param data 
+     * @param size should not cross a page
+     * @param typical cpu cycles the program typically takes
+     */
+    static void write(const uint32_t address, const uint8_t *const data, const uint32_t size, const uint32_t typical) {
+        write_enable();
+
+        header(static_cast<uint8_t>(cmd::page_program), address);
+        Bus::write({data, size});
+        Cs::template set<true>();
+
+        chip_state::started(typical);
+    }
+
+    /**
+     * @brief Read data from the device
+     * 
+     * @param opcode read or fast read
+     * @param address 
+     * @param data 
+     * @param size 
+     */
+    static void read(const cmd opcode, const uint32_t address, uint8_t *const data, const uint32_t size) {
+        read_header(opcode, address);
+
+        // the data is used as the transmit data. The device ignores the 
+        // input while it sends the data
+        Bus::write_read({data, size}, {data, size});
+        Cs::template set<true>();
+    }
+
+    /**
+     * @brief Read data from the device and pass every byte to a sink 
+     * as it is received. Does not need a buffer
+     * 
+     * @tparam Sink 
+     * @param opcode read or fast read
+     * @param address 
+     * @param size 
+     * @param sink bool(uint8_t). Stops the read when it returns false
+     * @return uint32_t amount of bytes passed to the sink
+     */
+    template <typename Sink>
+    static uint32_t read(const cmd opcode, const uint32_t address, const uint32_t size, Sink&& sink) {
+        read_header(opcode, address);
+
+        const uint32_t count = Stream::receive(size, sink);
+
+        Cs::template set<true>();
+
+        return count;
+    }
+};
+
+#endif
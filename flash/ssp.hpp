@@ -0,0 +1,82 @@
+#ifndef FLASH_SSP_HPP
+#define FLASH_SSP_HPP
+
+#include <cstdint>
+
+/**
+ * @brief Receive path of a lpc17xx ssp peripheral. Clocks dummy bytes out
+ * and passes every received byte to a sink straight from the receive
+ * fifo. The transmit fifo is kept filled so the bus never stalls while
+ * the sink runs. Used for the data phase of a read command that was
+ * started with the spi driver.
+ * 
+ * @tparam Base base address of the ssp peripheral
+ */
+template <uint32_t Base>
+class ssp_stream {
+protected:
+    // data and status register
+    static inline volatile uint32_t *const dr = reinterpret_cast<volatile uint32_t*>(Base + 0x08);
+    static inline volatile uint32_t *const sr = reinterpret_cast<volatile uint32_t*>(Base + 0x0c);
+
+    // status register bits
+    constexpr static uint32_t tnf = (0x1 << 1);
+    constexpr static uint32_t rne = (0x1 << 2);
+    constexpr static uint32_t bsy = (0x1 << 4);
+
+    // size of the fifos. Never have more bytes in flight than the
+    // receive fifo can hold
+    constexpr static uint32_t depth = 8;
+
+public:
+    /**
+     * @brief Receive bytes and pass them to the sink. Stops clocking new
+     * bytes when the sink returns false. The bytes in flight are still
+     * received but not passed to the sink
+     * 
+     * @tparam Sink
+     * @param size
+     * @param sink bool(uint8_t) called for every received byte
+     * @return uint32_t amount of bytes passed to the sink
+     */
+    template <typename Sink>
+    static uint32_t receive(const uint32_t size, Sink&& sink) {
+        // remove the bytes the spi driver left in the receive fifo
+        while ((*sr) & bsy) {
+            // wait
+        }
+
+        while ((*sr) & rne) {
+            (void)(*dr);
+        }
+
+        uint32_t sent = 0;
+        uint32_t received = 0;
+        uint32_t accepted = 0;
+        bool running = true;
+
+        while (received < sent || (running && sent < size)) {
+            // keep the transmit fifo filled
+            while (running && sent < size && (sent - received) < depth && ((*sr) & tnf)) {
+                (*dr) = 0x00;
+                sent++;
+            }
+
+            // pass the received bytes to the sink
+            while (received < sent && ((*sr) & rne)) {
+                const uint8_t data = (*dr);
+
+                received++;
+
+                if (running) {
+                    running = sink(data);
+                    accepted++;
+                }
+            }
+        }
+
+        return accepted;
+    }
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef FLASH_STATE_HPP
+#define FLASH_STATE_HPP
+
+#include <cstdint>
+
+#include "cycles.hpp"
+
+/**
+ * @brief Model of the state of a spi nor device. Tracks the write enable
+ * latch and the write in progress bit from the commands the loader sends
+ * and the non volatile status bits (block protect and quad enable) from
+ * the status register. Used to skip status polls that can only return
+ * busy and to detect when the device does something else than expected.
+ * 
+ * @details the model is unknown until sync is called. Every status poll
+ * is compared with the model. A difference in the non volatile bits or a
+ * write enable latch that is still set after a program or erase (the
+ * device ignored the command) marks the model as diverged. 
+ * 
+ * Continuous read mode is not modelled. The loader never enters it, it 
+ * only clears it when a previous user left the device in it before the
+ * model is synced.
+ * 
+ */
+class chip_state {
+public:
+    // status register bits
+    constexpr static uint8_t wip = (0x1 << 0);
+    constexpr static uint8_t wel = (0x1 << 1);
+    constexpr static uint8_t bp = (0xf << 2);
+    constexpr static uint8_t qe = (0x1 << 6);
+
+protected:
+    // flag if the non volatile bits are known
+    static inline bool known = false;
+
+    // expected value of the block protect and quad enable bits
+    static inline uint8_t expected = 0;
+
+    // write enable latch
+    static inline bool write_enabled = false;
+
+    // flag if a program, erase or status write is running
+    static inline bool in_progress = false;
+
+    // cycle count when the running operation started and the amount of
+    // cycles it typically takes
+    static inline uint32_t start = 0;
+    static inline uint32_t duration = 0;
+
+    // flag if a poll did not match the model
+    static inline bool mismatch = false;
+
+public:
+    /**
+     * @brief Forget everything about the device. The next poll always
+     * goes to the device
+     * 
+     */
+    static void reset() {
+        known = false;
+        write_enabled = false;
+        in_progress = false;
+        mismatch = false;
+    }
+
+    /**
+     * @brief Set the model from a status register value
+     * 
+     * @param status
+     */
+    static void sync(const uint8_t status) {
+        known = true;
+        expected = status & (bp | qe);
+        write_enabled = status & wel;
+        in_progress = status & wip;
+        mismatch = false;
+    }
+
+    /**
+     * @brief Returns if a write enable has to be send before a program,
+     * erase or status write
+     * 
+     * @return true
+     */
+    static bool needs_write_enable() {
+        return !write_enabled;
+    }
+
+    /**
+     * @brief Mark a write enable was send
+     * 
+     */
+    static void write_enable() {
+        write_enabled = true;
+    }
+
+    /**
+     * @brief Mark a program, erase or status write was started. The
+     * device clears the write enable latch when it is done
+     * 
+     * @param typical cycles the operation typically takes
+     */
+    static void started(const uint32_t typical) {
+        in_progress = true;
+        start = cycles::get();
+        duration = typical;
+    }
+
+    /**
+     * @brief Mark a status register write was started. The new block
+     * protect and quad enable bits are expected from now on
+     * 
+     * @param status value that is written
+     * @param typical cycles the write typically takes
+     */
+    static void status_written(const uint8_t status, const uint32_t typical) {
+        expected = status & (bp | qe);
+
+        started(typical);
+    }
+
+    /**
+     * @brief Returns if the device has to be polled to know if it is busy
+     * 
+     * @return true when the model does not know the answer
+     */
+    static bool poll_needed() {
+        // the device is idle until we start something
+        if (known && !in_progress) {
+            return false;
+        }
+
+        // do not poll before the typical time of the operation
+        return !in_progress || (cycles::get() - start) >= duration;
+    }
+
+    /**
+     * @brief Returns if the model thinks the device is busy
+     * 
+     * @return true
+     */
+    static bool busy() {
+        return in_progress;
+    }
+
+    /**
+     * @brief Update the model with a status poll and check it against the
+     * model
+     * 
+     * @param status
+     */
+    static void polled(const uint8_t status) {
+        // the non volatile bits should never change during a session
+        if (known && (status & (bp | qe)) != expected) {
+            mismatch = true;
+        }
+
+        // the latch is cleared when a program or erase is done. When it
+        // is still set the device did not run the command
+        if (in_progress && !(status & wip) && (status & wel)) {
+            mismatch = true;
+        }
+
+        in_progress = status & wip;
+        write_enabled = status & wel;
+    }
+
+    /**
+     * @brief Returns if every poll matched the model
+     * 
+     * @return true
+     */
+    static bool consistent() {
+        return !mismatch;
+    }
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef FLASH_TIMING_HPP
+#define FLASH_TIMING_HPP
+
+#include <cstdint>
+
+namespace timing {
+    /**
+     * @brief Typical and maximum duration of a single operation in 
+     * microseconds
+     * 
+     */
+    struct operation {
+        // typical duration
+        uint32_t typical;
+
+        // maximum duration. Used as the timeout
+        uint32_t maximum;
+    };
+
+    /**
+     * @brief Busy times of a flash device
+     * 
+     */
+    struct device {
+        // program a single page
+        operation page_program;
+
+        // erase a 4k sector
+        operation sector_erase;
+
+        // erase a 32k block
+        operation block_erase_32k;
+
+        // erase a 64k block
+        operation block_erase_64k;
+
+        // erase the whole chip
+        operation chip_erase;
+
+        // write the status register (tW)
+        operation write_status;
+
+        // power-up until the device accepts commands (tPUW)
+        operation power_up;
+
+        // release from deep power-down (tRES1)
+        operation release_power_down;
+
+        // minimum chip select high time in nanoseconds (tSHSL)
+        uint32_t cs_high;
+
+        // minimum chip select hold time after the last clock in 
+        // nanoseconds (tCHSH)
+        uint32_t cs_hold;
+    };
+
+    // timings from the is25lq040b datasheet
+    constexpr static device is25lq040b = {
+        .page_program = {200, 800},
+        .sector_erase = {70'000, 300'000},
+        .block_erase_32k = {100'000, 500'000},
+        .block_erase_64k = {150'000, 1'000'000},
+        .chip_erase = {1'000'000, 3'000'000},
+        .write_status = {2'000, 15'000},
+        .power_up = {1'000, 10'000},
+        .release_power_down = {3, 3},
+        .cs_high = 30,
+        .cs_hold = 5,
+    };
+
+    // timings from the w25q40cl datasheet
+    constexpr static device w25q40cl = {
+        .page_program = {700, 3'000},
+        .sector_erase = {45'000, 400'000},
+        .block_erase_32k = {120'000, 1'600'000},
+        .block_erase_64k = {150'000, 2'000'000},
+        .chip_erase = {1'000'000, 4'000'000},
+        .write_status = {10'000, 15'000},
+        .power_up = {1'000, 10'000},
+        .release_power_down = {3, 3},
+        .cs_high = 50,
+        .cs_hold = 5,
+    };
+
+    // timings from the gd25q40c datasheet
+    constexpr static device gd25q40c = {
+        .page_program = {600, 2'400},
+        .sector_erase = {50'000, 400'000},
+        .block_erase_32k = {150'000, 800'000},
+        .block_erase_64k = {250'000, 1'200'000},
+        .chip_erase = {1'500'000, 5'000'000},
+        .write_status = {5'000, 30'000},
+        .power_up = {1'000, 10'000},
+        .release_power_down = {20, 20},
+        .cs_high = 20,
+        .cs_hold = 5,
+    };
+
+    // timings from the mx25l4006e datasheet. The device has no 32k 
+    // block erase
+    constexpr static device mx25l4006e = {
+        .page_program = {1'400, 5'000},
+        .sector_erase = {60'000, 300'000},
+        .block_erase_32k = {0, 0},
+        .block_erase_64k = {700'000, 2'000'000},
+        .chip_erase = {3'500'000, 7'500'000},
+        .write_status = {5'000, 40'000},
+        .power_up = {1'000, 10'000},
+        .release_power_down = {9, 9},
+        .cs_high = 50,
+        .cs_hold = 5,
+    };
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef FLASH_TRACE_HPP
+#define FLASH_TRACE_HPP
+
+#include <cstdint>
+
+#include "cycles.hpp"
+
+namespace trace {
+    /**
+     * @brief Events the loader records. Call events have the progress
+     * operation as argument
+     * 
+     */
+    enum class event: uint8_t {
+        call = 0,
+        transfer = 1,
+        erase = 2,
+        busy = 3,
+        read = 4,
+        blank = 5,
+        hash = 6,
+        crc = 7,
+    };
+
+    // marker of a trace buffer that is initialized
+    constexpr static uint32_t marker = 0x54524345;
+
+    // flag in the id of a entry that marks the end of a event
+    constexpr static uint32_t end_flag = 0x80000000;
+
+    /**
+     * @brief Single entry in the trace buffer
+     * 
+     */
+    struct entry {
+        // cycle count when the event started or ended
+        uint32_t timestamp;
+
+        // end flag, event in bits 8 - 15 and the argument in bits 0 - 7
+        uint32_t id;
+    };
+
+    /**
+     * @brief Header of the ring buffer with the last events. The entries
+     * are allocated from the heap region during Init. Both survive 
+     * between the ramcode calls so the host can read the timeline of a 
+     * whole session
+     * 
+     */
+    struct buffer {
+        // marker when the buffer is initialized. The host can clear it
+        // to restart the trace at the next Init
+        uint32_t marker;
+
+        // amount of entries written. The next entry is at head % size
+        uint32_t head;
+
+        // amount of entries in the ring. Always a power of 2
+        uint32_t size;
+
+        // amount of entries that were overwritten before the host read
+        // them. The timeline misses the start of the session when this 
+        // is not 0
+        uint32_t overwritten;
+
+        // address of the entries
+        entry* entries;
+    };
+}
+
+extern "C" {
+    // trace buffer of the loader. Only exists when tracing is enabled
+    extern volatile trace::buffer LoaderTrace;
+}
+
+namespace trace {
+    /**
+     * @brief Writes events to the trace buffer. Does nothing when it is
+     * not enabled so the calls can stay in the code
+     * 
+     * @tparam Enabled
+     */
+    template <bool Enabled>
+    class recorder {
+    protected:
+        /**
+         * @brief Write a entry to the trace buffer
+         * 
+         * @param id
+         * @param timestamp
+         */
+        static void write(const uint32_t id, const uint32_t timestamp) {
+            // the events before the ring is allocated are not recorded
+            if (LoaderTrace.marker != marker) {
+                return;
+            }
+
+            const uint32_t head = LoaderTrace.head;
+            const uint32_t index = head & (LoaderTrace.size - 1);
+
+            // check if we overwrite a entry the host has not seen
+            if (head >= LoaderTrace.size) {
+                LoaderTrace.overwritten = LoaderTrace.overwritten + 1;
+            }
+
+            LoaderTrace.entries[index].timestamp = timestamp;
+            LoaderTrace.entries[index].id = id;
+
+            // update the head as the last item so the host sees a
+            // consistent entry
+            LoaderTrace.head = head + 1;
+        }
+
+    public:
+        /**
+         * @brief Attach the ring to the trace buffer. Called during every
+         * Init. The events of the previous calls are kept when the ring 
+         * did not move
+         * 
+         * @param entries
+         * @param size amount of entries. Should be a power of 2
+         */
+        static void setup(entry *const entries, const uint32_t size) {
+            if constexpr (Enabled) {
+                // the header is in the data section so the marker is 
+                // cleared every time the loader is downloaded
+                if (LoaderTrace.marker == marker && LoaderTrace.entries == entries && LoaderTrace.size == size) {
+                    return;
+                }
+
+                LoaderTrace.head = 0;
+                LoaderTrace.overwritten = 0;
+                LoaderTrace.size = size;
+                LoaderTrace.entries = entries;
+                LoaderTrace.marker = marker;
+            }
+        }
+
+        /**
+         * @brief Mark the start of a event
+         * 
+         * @param ev
+         * @param argument
+         */
+        static void begin(const event ev, const uint8_t argument = 0) {
+            if constexpr (Enabled) {
+                write((static_cast<uint32_t>(ev) << 8) | argument, cycles::get());
+            }
+        }
+
+        /**
+         * @brief Mark the start of a event that started earlier. Should
+         * be called before any other event is recorded after the start
+         * 
+         * @param timestamp cycle count when the event started
+         * @param ev
+         * @param argument
+         */
+        static void begin_at(const uint32_t timestamp, const event ev, const uint8_t argument = 0) {
+            if constexpr (Enabled) {
+                write((static_cast<uint32_t>(ev) << 8) | argument, timestamp);
+            }
+        }
+
+        /**
+         * @brief Mark the end of a event
+         * 
+         * @param ev
+         * @param argument
+         */
+        static void end(const event ev, const uint8_t argument = 0) {
+            if constexpr (Enabled) {
+                write(end_flag | (static_cast<uint32_t>(ev) << 8) | argument, cycles::get());
+            }
+        }
+
+        /**
+         * @brief Records a event for the lifetime of the scope
+         * 
+         */
+        class scope {
+        protected:
+            const event ev;
+            const uint8_t argument;
+
+        public:
+            scope(const event ev, const uint8_t argument = 0, const bool record = true):
+                ev(ev), argument(argument)
+            {
+                // the caller records the start with begin_at when it is
+                // not recorded here
+                if (record) {
+                    begin(ev, argument);
+                }
+            }
+
+            ~scope() {
+                end(ev, argument);
+            }
+        };
+    };
+}
+
+#endif
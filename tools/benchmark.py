@@ -0,0 +1,606 @@
+#!/usr/bin/env python3
+"""
+Host benchmarks for the flash loader using the model in simulator.py.
+
+usage:
+    benchmark.py faults     time to detect and recover from chip faults
+    benchmark.py linetime   session time distribution from the datasheet timings
+    benchmark.py sweep      session time for every loader configuration
+    benchmark.py cs         cycles saved by the fast chip select
+    benchmark.py vcd        waveform of a session for GTKWave
+    benchmark.py trace      timeline of a session in the chrome trace format
+    benchmark.py golden     bus transactions per page and sector with and without the state model
+    benchmark.py priority   time until the critical regions are done with the batch program
+"""
+
+import argparse
+import csv
+import itertools
+import json
+import multiprocessing
+import os
+import statistics
+import sys
+
+import simulator
+import timeline
+
+
+def erased(chip):
+    """ Prepare a chip that is fully erased """
+    chip.memory[:] = b'\xff' * chip.SIZE
+
+
+def programmed(chip):
+    """ Prepare a chip with data in the first 64k """
+    chip.memory[:0x10000] = bytes(range(256)) * 0x100
+
+
+# loader paths with the preparation of the chip, the expected result and
+# the expected contents of the chip from the contents before the path
+PATHS = {
+    'init': (erased, lambda loader: loader.init(), 0, lambda memory: memory),
+    'erase_sector': (
+        programmed, lambda loader: loader.erase_sector(0), 0,
+        lambda memory: (b'\xff' * 0x1000) + memory[0x1000:]
+    ),
+    'erase_chip': (programmed, lambda loader: loader.erase_chip(), 0, lambda memory: b'\xff' * len(memory)),
+    'program_page': (
+        erased, lambda loader: loader.program_page(0, bytes(range(256))), 0,
+        lambda memory: bytes(range(256)) + memory[256:]
+    ),
+    'blank_check': (erased, lambda loader: loader.blank_check(0, 0x10000), 0, lambda memory: memory),
+}
+
+# faults with the spi clock to run at and if the fault is still there
+# after a retry
+FAULTS = {
+    'delayed_busy': (lambda: simulator.DelayedBusy(delay=250_000), 1_000_000, False),
+    'stuck_wip': (lambda: simulator.StuckBusy(), 1_000_000, True),
+    'bit_flip': (lambda: simulator.BitFlip(clock=12_000_000, interval=1024), 12_000_000, False),
+    'no_response': (lambda: simulator.NoResponse(), 1_000_000, True),
+}
+
+
+def run(path, fault, clock):
+    """
+    Run a single loader path. Returns the outcome and the time it took. The
+    outcome is ok, error (the loader reported the failure) or undetected 
+    (the loader reported success but the chip does not have the expected
+    contents)
+    """
+    prepare, call, expected, contents = PATHS[path]
+
+    chip = simulator.Chip(faults=[fault] if fault else [])
+    prepare(chip)
+
+    before = bytes(chip.memory)
+
+    bus = simulator.Bus(chip, clock=clock)
+    loader = simulator.Loader(bus)
+
+    result = loader.init()
+
+    if not result and path != 'init':
+        result = call(loader)
+
+    if result != expected:
+        return 'error', bus.now
+
+    if bytes(chip.memory) != contents(before):
+        return 'undetected', bus.now
+
+    return 'ok', bus.now
+
+
+def faults(args):
+    print('{:<14} {:<14} {:>14} {:>14} {:>11} {:>14}'.format(
+        'path', 'fault', 'nominal [ms]', 'faulted [ms]', 'result', 'recover [ms]'
+    ))
+
+    for path in PATHS:
+        for name, (fault, clock, persistent) in FAULTS.items():
+            # the nominal time at the clock of the fault
+            _, nominal = run(path, None, clock)
+
+            outcome, detect = run(path, fault(), clock)
+
+            if outcome == 'ok':
+                # the fault did not cause a failure. Only the time changed
+                recover = detect
+            elif outcome == 'undetected':
+                # the station does not know it has to retry
+                recover = None
+            else:
+                # the station re-runs the path at half the spi clock after
+                # a failure. A transient fault is gone on the retry
+                retry, duration = run(path, fault() if persistent else None, clock // 2)
+                recover = (detect + duration) if retry == 'ok' else None
+
+            print('{:<14} {:<14} {:>14.3f} {:>14.3f} {:>11} {:>14}'.format(
+                path, name, nominal / 1000, detect / 1000, outcome,
+                'failed' if recover is None else '{:.3f}'.format(recover / 1000)
+            ))
+
+    return 0
+
+
+# loader configurations for the line time with the image size and if the
+# chip is erased with a chip erase
+CONFIGURATIONS = {
+    '64k_sector_erase': (0x10000, 'sector'),
+    '64k_planned_erase': (0x10000, 'planned'),
+    '64k_chip_erase': (0x10000, 'chip'),
+    '512k_sector_erase': (0x80000, 'sector'),
+    '512k_planned_erase': (0x80000, 'planned'),
+    '512k_chip_erase': (0x80000, 'chip'),
+}
+
+
+# contents of the device before the session and the image to program
+PATTERN = bytes(range(256)) * (simulator.Chip.SIZE // 256)
+IMAGE = bytes((i * 7) & 0xff for i in range(256)) * (simulator.Chip.SIZE // 256)
+
+
+def linetime_session(job):
+    """ Run a single session with sampled busy times. Returns the session time """
+    configuration, seed = job
+    size, erase = CONFIGURATIONS[configuration]
+
+    chip = simulator.Chip(sampler=simulator.Sampler(seed))
+    chip.memory[:] = PATTERN
+
+    bus = simulator.Bus(chip)
+    image = IMAGE[:size]
+
+    if simulator.session(simulator.Loader(bus), image, erase):
+        return None
+
+    return bus.now
+
+
+def percentile(values, p):
+    """ Nearest rank percentile of a sorted list """
+    return values[min(len(values) - 1, (len(values) * p) // 100)]
+
+
+def linetime(args):
+    print('{:<20} {:>8} {:>10} {:>10} {:>10} {:>10}'.format(
+        'configuration', 'failed', 'mean [s]', 'p50 [s]', 'p95 [s]', 'p99 [s]'
+    ))
+
+    with multiprocessing.Pool(args.jobs) as pool:
+        for configuration in CONFIGURATIONS:
+            # every session gets its own seed so the run is reproducible
+            jobs = [(configuration, (args.seed * args.sessions) + i) for i in range(args.sessions)]
+            results = pool.map(linetime_session, jobs, chunksize=8)
+
+            times = sorted(t / 1e6 for t in results if t is not None)
+
+            print('{:<20} {:>8} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}'.format(
+                configuration, len(results) - len(times), statistics.mean(times),
+                percentile(times, 50), percentile(times, 95), percentile(times, 99)
+            ))
+
+    return 0
+
+
+# parameters of the configuration matrix
+MATRIX = {
+    'clock': [1_000_000, 4_000_000, 12_000_000, 24_000_000],
+    'poll_interval': [3000, 500, 100, 20],
+    'erase': ['sector', 'block_32k', 'block_64k', 'planned', 'chip'],
+    'buffer': [0x100, 0x400, 0x1000, 0x2000],
+    'image': ['random', 'sparse', 'zero'],
+}
+
+
+def image(kind, size):
+    """ Generate a image to program """
+    if kind == 'zero':
+        return bytes(size)
+
+    data = bytearray(IMAGE[:size])
+
+    if kind == 'sparse':
+        # only the first 256 bytes of every 4k sector hold data
+        for offset in range(0, size, 0x1000):
+            data[offset + 0x100:offset + 0x1000] = b'\xff' * len(data[offset + 0x100:offset + 0x1000])
+
+    return bytes(data)
+
+
+def sweep_session(configuration):
+    """
+    Run a single session for a configuration. Every call creates its own
+    chip, bus and loader so workers never share state
+    """
+    chip = simulator.Chip()
+    chip.memory[:] = PATTERN
+
+    bus = simulator.Bus(chip, clock=configuration['clock'])
+    loader = simulator.Loader(
+        bus, read_size=configuration['buffer'], poll_interval=configuration['poll_interval']
+    )
+
+    result = simulator.session(
+        loader, image(configuration['image'], configuration['size']), configuration['erase']
+    )
+
+    return dict(
+        configuration, result=result, time=bus.now,
+        transactions=bus.transactions, bytes=bus.bytes
+    )
+
+
+def sweep(args):
+    # create every combination of the matrix
+    configurations = [
+        dict(zip(MATRIX, values), size=args.size)
+        for values in itertools.product(*MATRIX.values())
+    ]
+
+    with multiprocessing.Pool(args.jobs) as pool:
+        results = pool.map(sweep_session, configurations, chunksize=4)
+
+    with open(args.output, 'w', newline='') as file:
+        if args.output.endswith('.csv'):
+            writer = csv.DictWriter(file, fieldnames=list(results[0]))
+            writer.writeheader()
+            writer.writerows(results)
+        else:
+            json.dump(results, file, indent=1)
+
+    best = min((r for r in results if not r['result']), key=lambda r: r['time'])
+
+    print('{} configurations written to {}'.format(len(results), args.output))
+    print('fastest: {} ({:.3f} s)'.format(
+        ', '.join('{}={}'.format(k, best[k]) for k in MATRIX), best['time'] / 1e6
+    ))
+
+    return 0
+
+
+def cs(args):
+    # count the transactions (chip select toggles) of programming pages
+    chip = simulator.Chip()
+    bus = simulator.Bus(chip)
+    loader = simulator.Loader(bus)
+
+    pages = 64
+    loader.program(0, IMAGE[:pages * chip.PAGE_SIZE])
+
+    per_page = bus.transactions / pages
+    saved = per_page * (args.generic - args.fast)
+
+    print('chip select toggle: {} cycles generic, {} cycles fast'.format(args.generic, args.fast))
+    print('transactions per page program: {:.1f}'.format(per_page))
+    print('cycles saved per page program: {:.0f} ({:.2f} us at {} MHz)'.format(
+        saved, (saved * 1e6) / bus.cpu_clock, bus.cpu_clock // 1_000_000
+    ))
+    print('cycles saved per 512k image: {:.0f} ({:.2f} ms)'.format(
+        saved * (chip.SIZE // chip.PAGE_SIZE),
+        (saved * (chip.SIZE // chip.PAGE_SIZE) * 1e3) / bus.cpu_clock
+    ))
+
+    return 0
+
+
+def vcd(args):
+    # the waveform has 4 value changes for every bit so keep the image small
+    chip = simulator.Chip()
+    chip.memory[:] = PATTERN
+
+    with open(args.output, 'w') as file:
+        bus = simulator.Bus(chip, clock=args.clock, vcd=simulator.Vcd(file))
+        loader = simulator.Loader(bus, read_size=args.buffer, poll_interval=args.poll_interval)
+
+        result = simulator.session(loader, IMAGE[:args.size], args.erase)
+
+    print('{} transactions ({:.3f} ms) written to {}'.format(bus.transactions, bus.now / 1000, args.output))
+
+    return result
+
+
+def trace(args):
+    chip = simulator.Chip()
+    chip.memory[:] = PATTERN
+
+    bus = simulator.Bus(chip, clock=args.clock)
+    events = timeline.Timeline()
+    loader = simulator.Loader(bus, read_size=args.buffer, poll_interval=args.poll_interval, timeline=events)
+
+    result = simulator.session(loader, IMAGE[:args.size], args.erase)
+
+    with open(args.output, 'w') as file:
+        events.write(file)
+
+    print('{} events ({:.3f} ms) written to {}'.format(len(events.events) - 1, bus.now / 1000, args.output))
+
+    return result
+
+
+class Recorder(simulator.Bus):
+    """ Bus that keeps the command of every transaction """
+
+    def __init__(self, chip, **kwargs):
+        super().__init__(chip, **kwargs)
+        self.commands = []
+
+    def transfer(self, mosi):
+        self.commands.append(mosi[0])
+
+        return super().transfer(mosi)
+
+
+# groups of the commands in the golden breakdown
+GOLDEN_COMMANDS = {
+    'wren': [simulator.CMD_WRITE_ENABLE],
+    'erase': [
+        simulator.CMD_SECTOR_ERASE, simulator.CMD_SECTOR_ERASE_ALT,
+        simulator.CMD_BLOCK_ERASE_32K, simulator.CMD_BLOCK_ERASE_64K,
+    ],
+    'program': [simulator.CMD_PAGE_PROGRAM],
+    'status': [simulator.CMD_READ_STATUS],
+}
+
+
+def golden_run(track_state, clock, pages, sectors, poll_interval=None):
+    """
+    Erase sectors and program pages with or without the state model.
+    Returns the commands of the erase and the program
+    """
+    chip = simulator.Chip()
+    chip.memory[:] = PATTERN
+
+    bus = Recorder(chip, clock=clock)
+    loader = simulator.Loader(bus, poll_interval=poll_interval, track_state=track_state)
+
+    if loader.init():
+        return None
+
+    bus.commands.clear()
+
+    if loader.erase(0, sectors):
+        return None
+
+    erase = list(bus.commands)
+    bus.commands.clear()
+
+    if loader.program(0, IMAGE[:pages * chip.PAGE_SIZE]):
+        return None
+
+    return erase, list(bus.commands)
+
+
+def golden(args):
+    # the stateless loader is shown with the poll interval from before
+    # Init shortened it to the page program time as well. The short
+    # interval adds most of the status polls of a sector erase
+    runs = {
+        'stateless 3 ms': golden_run(False, args.clock, args.pages, args.sectors, simulator.Loader.POLL_INTERVAL),
+        'stateless': golden_run(False, args.clock, args.pages, args.sectors),
+        'state model': golden_run(True, args.clock, args.pages, args.sectors),
+    }
+
+    # the headline is the status reads. They are the only commands the
+    # state model removes
+    status = lambda commands, count: sum(c in GOLDEN_COMMANDS['status'] for c in commands) / count
+
+    print('{:<17} {:>14} {:>14} {:>14} {:>14}'.format(
+        'status reads', 'per sector', 'per page', 'total sector', 'total page'
+    ))
+
+    for name, commands in runs.items():
+        if commands is None:
+            print('{:<17} {:>14} {:>14} {:>14} {:>14}'.format(name, 'failed', 'failed', 'failed', 'failed'))
+            continue
+
+        erase, program = commands
+
+        print('{:<17} {:>14.1f} {:>14.1f} {:>14.1f} {:>14.1f}'.format(
+            name, status(erase, args.sectors), status(program, args.pages),
+            len(erase) / args.sectors, len(program) / args.pages
+        ))
+
+    # reduction of the status reads of the state model against both 
+    # stateless runs
+    model = runs['state model']
+
+    if model is not None:
+        print()
+
+        for name in ('stateless 3 ms', 'stateless'):
+            if runs[name] is None:
+                continue
+
+            print('{:<17} {:>14} {:>14}'.format(
+                'vs ' + name,
+                '-{:.1f}'.format(status(runs[name][0], args.sectors) - status(model[0], args.sectors)),
+                '-{:.1f}'.format(status(runs[name][1], args.pages) - status(model[1], args.pages)),
+            ))
+
+    # breakdown per command. Sector columns are the erase, page columns
+    # the program
+    print()
+    print('{:<14} {}'.format('per sector', ' '.join('{:>8}'.format(g) for g in GOLDEN_COMMANDS)))
+
+    for name, commands in runs.items():
+        if commands is not None:
+            print('{:<14} {}'.format(name, ' '.join(
+                '{:>8.1f}'.format(sum(c in codes for c in commands[0]) / args.sectors)
+                for codes in GOLDEN_COMMANDS.values()
+            )))
+
+    print('{:<14} {}'.format('per page', ' '.join('{:>8}'.format(g) for g in GOLDEN_COMMANDS)))
+
+    for name, commands in runs.items():
+        if commands is not None:
+            print('{:<14} {}'.format(name, ' '.join(
+                '{:>8.1f}'.format(sum(c in codes for c in commands[1]) / args.pages)
+                for codes in GOLDEN_COMMANDS.values()
+            )))
+
+    print()
+    print('the state model only removes status reads. Every erase and program clears')
+    print('the write enable latch, so the write enable count is the same in every run')
+    print()
+
+    # the golden trace is the command sequence of the loader with the 
+    # state model
+    trace = runs['state model']
+
+    if trace is None:
+        return 1
+
+    trace = ['{:02x}'.format(c) for c in trace[0] + trace[1]]
+
+    if args.output:
+        with open(args.output, 'w') as file:
+            file.write('\n'.join(trace) + '\n')
+
+        print('{} commands written to {}'.format(len(trace), args.output))
+
+    if args.compare:
+        with open(args.compare) as file:
+            expected = file.read().split()
+
+        for i, (a, b) in enumerate(zip(expected, trace)):
+            if a != b:
+                print('difference at command {}: expected {}, got {}'.format(i, a, b))
+                return 1
+
+        if len(expected) != len(trace):
+            print('expected {} commands, got {}'.format(len(expected), len(trace)))
+            return 1
+
+        print('matches {}'.format(args.compare))
+
+    return 0
+
+
+# regions of a image with the offset, size and if they are critical. The
+# bootloader is at the start and the config in the last sector
+LAYOUT = {
+    'bootloader': (0x00000, 0x4000, True),
+    'application': (0x04000, 0x7b000, False),
+    'config': (0x7f000, 0x1000, True),
+}
+
+
+def priority_run(critical_first, clock):
+    """
+    Program the layout with the batch program. Returns the result, the
+    time the critical regions are done and the total time
+    """
+    chip = simulator.Chip()
+    chip.memory[:] = PATTERN
+
+    bus = simulator.Bus(chip, clock=clock)
+    loader = simulator.Loader(bus)
+
+    if loader.init():
+        return 1, None, None
+
+    start = bus.now
+    finished = {}
+
+    # without the priority every region is bulk and the regions are 
+    # programmed in the order of the image
+    regions = [
+        (offset, IMAGE[offset:offset + size], critical and critical_first)
+        for offset, size, critical in sorted(LAYOUT.values())
+    ]
+
+    result = loader.program_batch(regions, lambda address: finished.setdefault(address, bus.now - start))
+
+    bootable = max(finished.get(offset, float('inf')) for offset, _, critical in LAYOUT.values() if critical)
+
+    return result, bootable, bus.now - start
+
+
+def priority(args):
+    print('{:<16} {:>8} {:>14} {:>14} {:>10}'.format(
+        'order', 'result', 'bootable [s]', 'total [s]', 'abort safe'
+    ))
+
+    for name, critical_first in (('image order', False), ('critical first', True)):
+        result, bootable, total = priority_run(critical_first, args.clock)
+
+        if result:
+            print('{:<16} {:>8}'.format(name, result))
+            continue
+
+        # chance a session that is aborted at a random time leaves the 
+        # critical regions done
+        print('{:<16} {:>8} {:>14.3f} {:>14.3f} {:>9.1f}%'.format(
+            name, 'ok', bootable / 1e6, total / 1e6, 100 * (total - bootable) / total
+        ))
+
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    commands.add_parser('faults', help='time to detect and recover from chip faults')
+
+    parser_linetime = commands.add_parser('linetime', help='session time distribution from the datasheet timings')
+    parser_linetime.add_argument('--sessions', type=int, default=2000, help='sessions per configuration')
+    parser_linetime.add_argument('--jobs', type=int, default=os.cpu_count(), help='worker processes')
+    parser_linetime.add_argument('--seed', type=int, default=0, help='seed of the first session')
+
+    parser_sweep = commands.add_parser('sweep', help='session time for every loader configuration')
+    parser_sweep.add_argument('--output', default='sweep.json', help='output file (.json or .csv)')
+    parser_sweep.add_argument('--size', type=lambda v: int(v, 0), default=0x10000, help='image size')
+    parser_sweep.add_argument('--jobs', type=int, default=os.cpu_count(), help='worker processes')
+
+    # there are no defaults. Pass the CsMeasurement values of the debug 
+    # code in flash/main.cpp
+    parser_cs = commands.add_parser('cs', help='cycles saved by the fast chip select')
+    parser_cs.add_argument('--generic', type=int, required=True, help='measured cycles per toggle of the generic pin')
+    parser_cs.add_argument('--fast', type=int, required=True, help='measured cycles per toggle of the chip select of the loader (cs)')
+
+    parser_vcd = commands.add_parser('vcd', help='waveform of a session for GTKWave')
+    parser_vcd.add_argument('--output', default='session.vcd', help='output file')
+    parser_vcd.add_argument('--size', type=lambda v: int(v, 0), default=0x1000, help='image size')
+    parser_vcd.add_argument('--erase', default='sector', choices=MATRIX['erase'], help='erase granularity')
+    parser_vcd.add_argument('--clock', type=int, default=1_000_000, help='spi clock')
+    parser_vcd.add_argument('--buffer', type=lambda v: int(v, 0), default=0x2000, help='read buffer size')
+    parser_vcd.add_argument('--poll-interval', type=int, default=None, help='status poll interval in us (default: typical page program time)')
+
+    parser_trace = commands.add_parser('trace', help='timeline of a session in the chrome trace format')
+    parser_trace.add_argument('--output', default='session.json', help='output file')
+    parser_trace.add_argument('--size', type=lambda v: int(v, 0), default=0x10000, help='image size')
+    parser_trace.add_argument('--erase', default='sector', choices=MATRIX['erase'], help='erase granularity')
+    parser_trace.add_argument('--clock', type=int, default=1_000_000, help='spi clock')
+    parser_trace.add_argument('--buffer', type=lambda v: int(v, 0), default=0x2000, help='read buffer size')
+    parser_trace.add_argument('--poll-interval', type=int, default=None, help='status poll interval in us (default: typical page program time)')
+
+    parser_golden = commands.add_parser('golden', help='bus transactions per page and sector with and without the state model')
+    parser_golden.add_argument('--clock', type=int, default=24_000_000, help='spi clock')
+    parser_golden.add_argument('--pages', type=int, default=64, help='pages to program')
+    parser_golden.add_argument('--sectors', type=int, default=16, help='sectors to erase')
+    parser_golden.add_argument('--output', default=None, help='write the commands of the state model to a file')
+    parser_golden.add_argument('--compare', default=None, help='compare the commands with a file written by --output')
+
+    parser_priority = commands.add_parser('priority', help='time until the critical regions are done with the batch program')
+    parser_priority.add_argument('--clock', type=int, default=24_000_000, help='spi clock')
+
+    args = parser.parse_args()
+
+    return {
+        'faults': faults,
+        'linetime': linetime,
+        'sweep': sweep,
+        'cs': cs,
+        'vcd': vcd,
+        'trace': trace,
+        'golden': golden,
+        'priority': priority,
+    }[args.command](args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
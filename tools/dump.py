@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""
+Decompress a readback dump of the Dump extension (see flash/dump.hpp).
+
+The stream is the concatenation of the compressed chunks the loader
+returned. Every token starts with a byte with the type in the upper 2
+bits:
+
+    literal  00llllll + <l + 1> bytes
+    erased   01llllll llllllll             <l + 1> bytes of the erase value
+    match    10llllll oooooooo oooooooo    <l + 4> bytes from <o + 1> bytes back
+    run      11llllll llllllll vvvvvvvv    <l + 1> bytes of v
+
+usage:
+    dump.py stream.bin image.bin [--erase-value 0xff]
+"""
+
+import argparse
+import sys
+
+
+def decompress(stream, erase_value=0xff):
+    """ Decompress a dump stream. Returns the data """
+    out = bytearray()
+    i = 0
+
+    while i < len(stream):
+        token = stream[i]
+        kind = token & 0xc0
+        length = token & 0x3f
+
+        if kind == 0x00:
+            out += stream[i + 1:i + 2 + length]
+            i += 2 + length
+        elif kind == 0x40:
+            out += bytes([erase_value]) * (((length << 8) | stream[i + 1]) + 1)
+            i += 2
+        elif kind == 0x80:
+            offset = (stream[i + 1] | (stream[i + 2] << 8)) + 1
+
+            # byte by byte as the match can overlap the output
+            for _ in range(length + 4):
+                out.append(out[-offset])
+
+            i += 3
+        else:
+            out += bytes([stream[i + 2]]) * (((length << 8) | stream[i + 1]) + 1)
+            i += 3
+
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('stream', help='compressed stream read from the loader')
+    parser.add_argument('image', help='output file')
+    parser.add_argument('--erase-value', type=lambda v: int(v, 0), default=0xff, help='erase value of the device')
+    args = parser.parse_args()
+
+    with open(args.stream, 'rb') as file:
+        stream = file.read()
+
+    data = decompress(stream, args.erase_value)
+
+    with open(args.image, 'wb') as file:
+        file.write(data)
+
+    print('{} bytes -> {} bytes'.format(len(stream), len(data)))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""
+Map the program counter histogram of the loader (LoaderProfile, see
+flash/profile.hpp) to the functions in the elf file.
+
+Read the histogram with J-Link after the session. The address is the
+LoaderProfile symbol of the loader:
+
+    arm-none-eabi-nm flash_loader.elf | grep LoaderProfile
+    J-Link> savebin profile.bin <address> 0x410
+
+usage:
+    hotspots.py profile.bin flash_loader.elf [--interval 9600] [--top 20]
+"""
+
+import argparse
+import shutil
+import struct
+import subprocess
+import sys
+
+from pack import Elf
+
+
+STT_FUNC = 2
+
+
+def demangle(names):
+    """ Demangle c++ names when c++filt is available """
+    tool = shutil.which('arm-none-eabi-c++filt') or shutil.which('c++filt')
+
+    if tool is None:
+        return names
+
+    result = subprocess.run([tool], input='\n'.join(names), capture_output=True, text=True)
+
+    return result.stdout.splitlines() if result.returncode == 0 else names
+
+
+def functions(elf):
+    """ Get the functions sorted on the address. The thumb bit is cleared """
+    result = sorted(
+        (value & ~1, size, name) for name, value, size, kind in elf.symbols()
+        if kind == STT_FUNC and size
+    )
+
+    names = demangle([name for _, _, name in result])
+
+    return [(address, size, name) for (address, size, _), name in zip(result, names)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('histogram', help='histogram read from the loader')
+    parser.add_argument('elf', help='loader the histogram was taken with')
+    parser.add_argument('--interval', type=int, default=9600, help='cpu cycles between samples (PROFILE_INTERVAL)')
+    parser.add_argument('--clock', type=int, default=96_000_000, help='cpu clock of the loader')
+    parser.add_argument('--top', type=int, default=20, help='amount of functions to show')
+    args = parser.parse_args()
+
+    with open(args.histogram, 'rb') as file:
+        data = file.read()
+
+    base, shift, samples, outside = struct.unpack_from('<IIII', data, 0)
+    counts = struct.unpack_from('<{}H'.format((len(data) - 16) // 2), data, 16)
+
+    if not samples:
+        print('hotspots: the histogram has no samples', file=sys.stderr)
+        return 1
+
+    with open(args.elf, 'rb') as file:
+        table = functions(Elf(file.read()))
+
+    # give every bucket to the function at the middle of the bucket. A
+    # bucket can have the end of a function and the start of the next
+    totals = {}
+
+    for bucket, count in enumerate(counts):
+        if not count:
+            continue
+
+        middle = base + (bucket << shift) + ((0x1 << shift) // 2)
+        name = next(
+            (name for address, size, name in table if address <= middle < (address + size)),
+            '<unknown 0x{:08x}>'.format(base + (bucket << shift))
+        )
+
+        totals[name] = totals.get(name, 0) + count
+
+    if outside:
+        totals['<outside the loader>'] = outside
+
+    print('{} samples ({:.3f} ms at {} cycles per sample)'.format(
+        samples, (samples * args.interval * 1e3) / args.clock, args.interval
+    ))
+    print('{:>8} {:>7}  {}'.format('samples', '[%]', 'function'))
+
+    for name, count in sorted(totals.items(), key=lambda item: item[1], reverse=True)[:args.top]:
+        print('{:>8} {:>7.2f}  {}'.format(count, (count * 100) / samples, name))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
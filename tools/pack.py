@@ -0,0 +1,360 @@
+#!/usr/bin/env python3
+"""
+Pack the flash loader behind the decompressor in entry/entry.c.
+
+The vector table up to the end of the data is compressed with the lz4
+block format and stored in a new ".packed" section at the start of the
+heap. PrgData stays at its place between the constructor tables and the
+data, so the sections before and after it are packed as two separate
+ranges. The packed sections are changed to NOBITS so they are not
+downloaded anymore and the ".unpack" header is filled in so Init (the
+first function J-Link calls) or the reset handler can unpack them in
+place. PrgCode, PrgData, DevDscr, Init and the decompressor are never
+packed.
+
+usage:
+    pack.py flash_loader.elf [--output packed.elf] [--clock 96000000]
+"""
+
+import argparse
+import struct
+import sys
+
+
+# sections that are unpacked by __unpack_loader. The entry section
+# (reset handler, Init and the decompressor), PrgCode, PrgData and 
+# DevDscr are never packed
+PACKED = ['.vectors', '.text', '.rodata', '.preinit_array', '.init_array', '.fini_array', '.data']
+
+# amount of ranges in the .unpack header (struct unpack_header in 
+# entry/entry.c). Every range has the destination, source and size
+RANGES = 2
+
+# lz4 block format limits
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MATCH_LIMIT = 12
+MAX_OFFSET = 0xffff
+
+# estimated cortex-m3 cycles of the decompressor running from ram. Every
+# token decodes the lengths and the offset, every byte is a load, store
+# and loop branch
+TOKEN_CYCLES = 24
+BYTE_CYCLES = 6
+
+SHT_PROGBITS = 1
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+PT_LOAD = 1
+
+
+def compress(data):
+    """
+    Compress data to a lz4 block. Greedy parser using the last position
+    of every 4 byte sequence. Returns the block and the amount of tokens
+    """
+    out = bytearray()
+    table = {}
+    tokens = 0
+
+    anchor = 0
+    i = 0
+    limit = len(data) - MATCH_LIMIT
+
+    def lengths(value):
+        # extra length bytes after the token
+        while value >= 255:
+            out.append(255)
+            value -= 255
+        out.append(value)
+
+    while i < limit:
+        key = data[i:i + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = i
+
+        if candidate is None or (i - candidate) > MAX_OFFSET:
+            i += 1
+            continue
+
+        # extend the match up to the last literals
+        length = MIN_MATCH
+        while (i + length) < (len(data) - LAST_LITERALS) and data[candidate + length] == data[i + length]:
+            length += 1
+
+        literals = i - anchor
+        out.append((min(literals, 15) << 4) | min(length - MIN_MATCH, 15))
+
+        if literals >= 15:
+            lengths(literals - 15)
+
+        out += data[anchor:i]
+        out += struct.pack('<H', i - candidate)
+
+        if (length - MIN_MATCH) >= 15:
+            lengths(length - MIN_MATCH - 15)
+
+        tokens += 1
+
+        # add the positions inside the match so later data can refer to it
+        for j in range(i + 1, min(i + length, limit)):
+            table[data[j:j + MIN_MATCH]] = j
+
+        i += length
+        anchor = i
+
+    # the block always ends with literals
+    literals = len(data) - anchor
+    out.append(min(literals, 15) << 4)
+
+    if literals >= 15:
+        lengths(literals - 15)
+
+    out += data[anchor:]
+    tokens += 1
+
+    return bytes(out), tokens
+
+
+def decompress(block):
+    """ Reference decompressor. Mirrors __unpack in entry/entry.c """
+    out = bytearray()
+    i = 0
+
+    while i < len(block):
+        token = block[i]
+        i += 1
+
+        def length(value):
+            nonlocal i
+            if value == 15:
+                while True:
+                    value += block[i]
+                    i += 1
+                    if block[i - 1] != 255:
+                        break
+            return value
+
+        literals = length(token >> 4)
+        out += block[i:i + literals]
+        i += literals
+
+        if i >= len(block):
+            break
+
+        offset = block[i] | (block[i + 1] << 8)
+        i += 2
+
+        for _ in range(length(token & 0xf) + MIN_MATCH):
+            out.append(out[-offset])
+
+    return bytes(out)
+
+
+class Elf:
+    """ Minimal 32 bit little endian elf file with the section and program headers """
+
+    def __init__(self, data):
+        self.data = bytearray(data)
+
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError('not a 32 bit little endian elf file')
+
+        (self.phoff, self.shoff, _, _, self.phentsize, phnum,
+         self.shentsize, shnum, self.shstrndx) = struct.unpack_from('<IIIHHHHHH', self.data, 28)
+
+        self.sections = [
+            list(struct.unpack_from('<IIIIIIIIII', self.data, self.shoff + (i * self.shentsize)))
+            for i in range(shnum)
+        ]
+
+    def name(self, section):
+        strtab = self.sections[self.shstrndx]
+        start = strtab[4] + section[0]
+        return self.data[start:self.data.index(b'\0', start)].decode()
+
+    def find(self, name):
+        for section in self.sections:
+            if self.name(section) == name:
+                return section
+
+        return None
+
+    def symbols(self):
+        """ All the symbols with the name, value, size and type """
+        symtab = self.find('.symtab')
+        strtab = self.sections[symtab[6]]
+
+        for offset in range(symtab[4], symtab[4] + symtab[5], 16):
+            index, value, size, info = struct.unpack_from('<IIIB', self.data, offset)
+            start = strtab[4] + index
+
+            yield self.data[start:self.data.index(b'\0', start)].decode(), value, size, info & 0xf
+
+    def symbol(self, name):
+        for symbol, value, _, _ in self.symbols():
+            if symbol == name:
+                return value
+
+        raise KeyError('symbol {} not found'.format(name))
+
+    def add_section(self, name, address, content):
+        """ Add a loadable section. The content is appended to the file """
+        while len(self.data) % 4:
+            self.data.append(0)
+
+        offset = len(self.data)
+        self.data += content
+
+        # copy the section names with the new name at the end
+        strtab = self.sections[self.shstrndx]
+        names = self.data[strtab[4]:strtab[4] + strtab[5]] + name.encode() + b'\0'
+
+        strtab[4] = len(self.data)
+        strtab[5] = len(names)
+        self.data += names
+
+        self.sections.append([
+            len(names) - len(name) - 1, SHT_PROGBITS, SHF_ALLOC, address,
+            offset, len(content), 0, 0, 4, 0
+        ])
+
+    def loaded(self):
+        """ All the sections that are downloaded to the target """
+        return [
+            s for s in self.sections
+            if s[1] == SHT_PROGBITS and (s[2] & SHF_ALLOC) and s[5]
+        ]
+
+    def write(self, path):
+        # add a load segment for every section that is downloaded. The
+        # original segments cover the packed sections as well
+        while len(self.data) % 4:
+            self.data.append(0)
+
+        phoff = len(self.data)
+        loaded = self.loaded()
+
+        for s in loaded:
+            self.data += struct.pack('<IIIIIIII', PT_LOAD, s[4], s[3], s[3], s[5], s[5], 0x7, 4)
+
+        shoff = len(self.data)
+
+        for s in self.sections:
+            self.data += struct.pack('<IIIIIIIIII', *s)
+
+        struct.pack_into('<II', self.data, 28, phoff, shoff)
+        struct.pack_into('<HHHH', self.data, 42, 32, len(loaded), self.shentsize, len(self.sections))
+
+        with open(path, 'wb') as file:
+            file.write(self.data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf', help='loader to pack')
+    parser.add_argument('--output', help='packed loader (default: overwrite the input)')
+    parser.add_argument('--clock', type=int, default=96_000_000, help='cpu clock for the startup time')
+    args = parser.parse_args()
+
+    with open(args.elf, 'rb') as file:
+        elf = Elf(file.read())
+
+    header = elf.find('.unpack')
+
+    if header is None or header[5] < (RANGES * 12):
+        print('pack: {} has no .unpack header'.format(args.elf), file=sys.stderr)
+        return 1
+
+    before = sum(s[5] for s in elf.loaded())
+
+    # get the packed sections in the order of the address
+    packed = sorted((
+        s for s in elf.sections
+        if elf.name(s) in PACKED and s[1] == SHT_PROGBITS and s[5]
+    ), key=lambda s: s[3])
+
+    others = [s for s in elf.loaded() if s not in packed]
+
+    # split the packed sections in ranges. A range ends at a loaded 
+    # section that is not packed (PrgData). Those are downloaded as is
+    # and should not be overwritten when a range is unpacked
+    ranges = []
+
+    for s in packed:
+        if ranges and not any(ranges[-1][-1][3] < o[3] < s[3] for o in others):
+            ranges[-1].append(s)
+        else:
+            ranges.append([s])
+
+    if len(ranges) > RANGES:
+        print('pack: {} packed ranges, the header has {}'.format(len(ranges), RANGES), file=sys.stderr)
+        return 1
+
+    # the packed data is placed at the start of the heap. The heap is not
+    # used before the loader is unpacked
+    source = (elf.symbol('__heap_start') + 3) & ~3
+    content = bytearray()
+
+    size = 0
+    cycles = 0
+
+    for i, sections in enumerate(ranges):
+        start = sections[0][3]
+        end = max(s[3] + s[5] for s in sections)
+
+        # the range is overwritten when it is unpacked. Sections J-Link 
+        # needs should not be in it
+        for o in others:
+            if o[3] < end and (o[3] + o[5]) > start:
+                print('pack: {} is inside the packed range'.format(elf.name(o)), file=sys.stderr)
+                return 1
+
+        # create the image of the range. Gaps between sections are zero
+        image = bytearray(end - start)
+
+        for s in sections:
+            image[s[3] - start:s[3] - start + s[5]] = elf.data[s[4]:s[4] + s[5]]
+
+        block, tokens = compress(bytes(image))
+
+        if decompress(block) != image:
+            print('pack: compressed image does not match', file=sys.stderr)
+            return 1
+
+        # fill in the header for the reset handler
+        struct.pack_into('<III', elf.data, header[4] + (i * 12), start, source + len(content), len(block))
+
+        content += block
+
+        while len(content) % 4:
+            content.append(0)
+
+        size += len(image)
+        cycles += (tokens * TOKEN_CYCLES) + (len(image) * BYTE_CYCLES)
+
+    if (source + len(content)) > elf.symbol('__heap_end'):
+        print('pack: packed loader ({} bytes) does not fit in the heap'.format(len(content)), file=sys.stderr)
+        return 1
+
+    for s in packed:
+        s[1] = SHT_NOBITS
+
+    elf.add_section('.packed', source, bytes(content))
+    elf.write(args.output or args.elf)
+
+    after = sum(s[5] for s in elf.loaded())
+
+    print('packed {} bytes in {} ranges to {} bytes ({:.1f}%)'.format(
+        size, len(ranges), len(content), (len(content) * 100) / size
+    ))
+    print('download: {} bytes -> {} bytes ({} bytes saved)'.format(before, after, before - after))
+    print('startup: ~{} cycles added ({:.1f} us at {} MHz)'.format(
+        cycles, (cycles * 1e6) / args.clock, args.clock // 1_000_000
+    ))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,743 @@
+#!/usr/bin/env python3
+"""
+Transaction level model of the is25lq040b and the flash loader ramcode.
+
+The chip model decodes the spi commands the loader sends and keeps track of
+the status register and the busy time of every operation. The loader model
+mirrors the command sequences and wait loops in flash/flash_device.cpp. All
+times are in microseconds of simulated time.
+"""
+
+import contextlib
+import random
+import zlib
+
+# datasheet busy times in microseconds (typical, maximum). These mirror
+# flash/timing.hpp
+DATASHEET = {
+    'page_program': (200, 800),
+    'sector_erase': (70_000, 300_000),
+    'block_erase_32k': (100_000, 500_000),
+    'block_erase_64k': (150_000, 1_000_000),
+    'chip_erase': (1_000_000, 3_000_000),
+    'write_status': (2_000, 15_000),
+    'power_up': (1_000, 10_000),
+    'release_power_down': (3, 3),
+}
+
+# commands used by the loader
+CMD_WRITE_STATUS = 0x01
+CMD_PAGE_PROGRAM = 0x02
+CMD_READ = 0x03
+CMD_READ_STATUS = 0x05
+CMD_WRITE_ENABLE = 0x06
+CMD_SECTOR_ERASE = 0xd7
+CMD_SECTOR_ERASE_ALT = 0x20
+CMD_BLOCK_ERASE_32K = 0x52
+CMD_BLOCK_ERASE_64K = 0xd8
+CMD_CHIP_ERASE = 0xc7
+CMD_CHIP_ERASE_ALT = 0x60
+CMD_JEDEC_ID = 0x9f
+CMD_RELEASE_POWER_DOWN = 0xab
+
+# erase commands with the operation name and the size they erase
+ERASE_COMMANDS = {
+    CMD_SECTOR_ERASE: ('sector_erase', 0x1000),
+    CMD_SECTOR_ERASE_ALT: ('sector_erase', 0x1000),
+    CMD_BLOCK_ERASE_32K: ('block_erase_32k', 0x8000),
+    CMD_BLOCK_ERASE_64K: ('block_erase_64k', 0x10000),
+}
+
+STATUS_WIP = 0x01
+STATUS_WEL = 0x02
+
+
+def typical(operation):
+    """ Busy time sampler that always returns the typical time """
+    return DATASHEET[operation][0]
+
+
+class Sampler:
+    """
+    Busy time sampler that draws every operation from a beta distribution
+    between half the typical time and the maximum time. The most likely
+    value is the typical time, the tail runs up to the maximum.
+    """
+
+    def __init__(self, seed=None, timing=DATASHEET):
+        self.random = random.Random(seed)
+        self.shapes = {}
+
+        for operation, (typ, maximum) in timing.items():
+            low = typ / 2
+
+            # a alpha of 2 puts the mode at 1 / beta
+            mode = (typ - low) / (maximum - low)
+            self.shapes[operation] = (low, maximum - low, 1 / mode)
+
+    def __call__(self, operation):
+        low, scale, beta = self.shapes[operation]
+
+        return low + (scale * self.random.betavariate(2, beta))
+
+
+class Fault:
+    """
+    Base class for a scripted fault. The chip calls the hooks on every
+    operation and every byte it drives on miso.
+    """
+
+    def busy_time(self, operation, duration):
+        """ Change the busy time of a operation """
+        return duration
+
+    def miso(self, value, clock):
+        """ Change a byte the chip drives on miso """
+        return value
+
+    def responds(self):
+        """ Returns if the chip answers at all """
+        return True
+
+
+class DelayedBusy(Fault):
+    """ Busy clears a fixed amount of time after it should have """
+
+    def __init__(self, delay, operations=None):
+        self.delay = delay
+        self.operations = operations
+
+    def busy_time(self, operation, duration):
+        if self.operations is None or operation in self.operations:
+            return duration + self.delay
+
+        return duration
+
+
+class StuckBusy(Fault):
+    """ The write in progress bit never clears after a operation """
+
+    def busy_time(self, operation, duration):
+        return float('inf')
+
+
+class BitFlip(Fault):
+    """
+    Flips a random bit in every interval bytes read when the spi clock is
+    at or above the clock limit
+    """
+
+    def __init__(self, clock, interval=4096, seed=0):
+        self.clock = clock
+        self.interval = interval
+        self.random = random.Random(seed)
+        self.count = 0
+
+    def miso(self, value, clock):
+        if clock < self.clock:
+            return value
+
+        self.count += 1
+
+        if self.count % self.interval:
+            return value
+
+        return value ^ (1 << self.random.randrange(8))
+
+
+class NoResponse(Fault):
+    """ No chip on the bus. Miso is pulled high """
+
+    def responds(self):
+        return False
+
+
+class Chip:
+    """ Model of the is25lq040b """
+
+    JEDEC_ID = bytes([0x9d, 0x40, 0x13])
+    SIZE = 0x80000
+    PAGE_SIZE = 0x100
+
+    def __init__(self, faults=(), sampler=typical, powered_down=False):
+        self.faults = list(faults)
+        self.sampler = sampler
+        self.memory = bytearray(b'\xff' * self.SIZE)
+        self.status = 0x00
+        self.busy_until = 0.0
+
+        # time the chip leaves deep power-down. None when it is in deep
+        # power-down
+        self.awake = None if powered_down else 0.0
+
+    def busy(self, now):
+        return now < self.busy_until
+
+    def start(self, now, operation):
+        """ Start a operation that keeps the chip busy """
+        duration = self.sampler(operation)
+
+        for fault in self.faults:
+            duration = fault.busy_time(operation, duration)
+
+        self.busy_until = now + duration
+
+    def transfer(self, now, clock, mosi):
+        """
+        Handle a single transaction (chip select low to high). Returns the
+        bytes on miso
+        """
+        if not all(fault.responds() for fault in self.faults):
+            return bytes(b'\xff' * len(mosi))
+
+        miso = self.decode(now, mosi)
+
+        # let the faults change the data on the bus
+        for fault in self.faults:
+            miso = bytes(fault.miso(value, clock) for value in miso)
+
+        return miso
+
+    def decode(self, now, mosi):
+        command = mosi[0]
+        padding = bytes(len(mosi))
+
+        # in deep power-down the chip only listens to the release command
+        if self.awake is None or now < self.awake:
+            if command == CMD_RELEASE_POWER_DOWN and self.awake is None:
+                self.awake = now + self.sampler('release_power_down')
+
+            return bytes(b'\xff' * len(mosi))
+
+        busy = self.busy(now)
+
+        if not busy:
+            # the write in progress bit clears together with the write
+            # enable latch
+            if self.status & STATUS_WIP:
+                self.status &= ~(STATUS_WIP | STATUS_WEL)
+
+        if command == CMD_READ_STATUS:
+            status = self.status | (STATUS_WIP if busy else 0)
+            return bytes([0]) + bytes([status] * (len(mosi) - 1))
+
+        if command == CMD_JEDEC_ID:
+            return (bytes([0]) + self.JEDEC_ID + padding)[:len(mosi)]
+
+        # the chip ignores everything else while it is busy
+        if busy:
+            return padding
+
+        address = int.from_bytes(mosi[1:4], 'big') % self.SIZE
+
+        if command == CMD_WRITE_ENABLE:
+            self.status |= STATUS_WEL
+
+        elif command == CMD_READ:
+            data = self.memory[address:address + len(mosi) - 4]
+            return bytes(4) + bytes(data)
+
+        elif command == CMD_PAGE_PROGRAM and self.status & STATUS_WEL:
+            page = address & ~(self.PAGE_SIZE - 1)
+            data = mosi[4:]
+
+            # programming can only clear bits
+            if address == page and len(data) == self.PAGE_SIZE:
+                current = int.from_bytes(self.memory[page:page + self.PAGE_SIZE], 'little')
+                value = current & int.from_bytes(data, 'little')
+                self.memory[page:page + self.PAGE_SIZE] = value.to_bytes(self.PAGE_SIZE, 'little')
+            else:
+                # a partial page wraps around in the page
+                for i, value in enumerate(data):
+                    offset = page + ((address + i) & (self.PAGE_SIZE - 1))
+                    self.memory[offset] &= value
+
+            self.status |= STATUS_WIP
+            self.start(now, 'page_program')
+
+        elif command in ERASE_COMMANDS and self.status & STATUS_WEL:
+            operation, size = ERASE_COMMANDS[command]
+            start = address & ~(size - 1)
+
+            self.memory[start:start + size] = b'\xff' * size
+            self.status |= STATUS_WIP
+            self.start(now, operation)
+
+        elif command in (CMD_CHIP_ERASE, CMD_CHIP_ERASE_ALT) and self.status & STATUS_WEL:
+            self.memory[:] = b'\xff' * self.SIZE
+            self.status |= STATUS_WIP
+            self.start(now, 'chip_erase')
+
+        return padding
+
+
+class Vcd:
+    """
+    Value change dump of the chip select, clock and data lines for GTKWave.
+    The bus runs in spi mode 3: the clock idles high, data changes on the
+    falling edge and is sampled on the rising edge. The command signal has
+    the first byte of every transaction while the chip select is low.
+    """
+
+    # signals with the width and the vcd identifier
+    SIGNALS = {
+        'cs': (1, '!'),
+        'sck': (1, '"'),
+        'mosi': (1, '#'),
+        'miso': (1, '$'),
+        'command': (8, '%'),
+    }
+
+    def __init__(self, file):
+        self.file = file
+        self.time = None
+        self.values = {}
+
+        self.file.write('$timescale 1ps $end\n')
+        self.file.write('$scope module spi $end\n')
+
+        for name, (width, identifier) in self.SIGNALS.items():
+            self.file.write('$var wire {} {} {} $end\n'.format(width, identifier, name))
+
+        self.file.write('$upscope $end\n$enddefinitions $end\n')
+
+        self.change(0.0, cs='1', sck='1', mosi='x', miso='z', command='x')
+
+    def change(self, time, **values):
+        """ Write the signals that changed at a time in microseconds """
+        changed = {k: v for k, v in values.items() if self.values.get(k) != v}
+
+        if not changed:
+            return
+
+        timestamp = round(time * 1e6)
+
+        if timestamp != self.time:
+            self.file.write('#{}\n'.format(timestamp))
+            self.time = timestamp
+
+        for name, value in changed.items():
+            width, identifier = self.SIGNALS[name]
+
+            if width == 1:
+                self.file.write('{}{}\n'.format(value, identifier))
+            else:
+                self.file.write('b{} {}\n'.format(value, identifier))
+
+            self.values[name] = value
+
+    def transaction(self, start, clock, mosi, miso):
+        """ Write a transaction that starts at a time in microseconds """
+        period = 1e6 / clock
+
+        self.change(start, cs='0', command='{:b}'.format(mosi[0]) if mosi else 'x')
+
+        for i in range(len(mosi) * 8):
+            shift = 7 - (i % 8)
+            time = start + (i * period)
+
+            self.change(
+                time, sck='0',
+                mosi=str((mosi[i // 8] >> shift) & 0x1),
+                miso=str((miso[i // 8] >> shift) & 0x1)
+            )
+            self.change(time + (period / 2), sck='1')
+
+        self.change(start + (len(mosi) * 8 * period), cs='1', mosi='x', miso='z', command='x')
+
+
+class Bus:
+    """
+    Spi bus with a chip select. Keeps the simulated time and counts the
+    transactions and bytes that go over the bus. Every transaction is
+    written to the vcd recorder when there is one.
+    """
+
+    def __init__(self, chip, clock=1_000_000, cpu_clock=96_000_000, overhead=200, vcd=None):
+        self.chip = chip
+        self.clock = clock
+        self.cpu_clock = cpu_clock
+
+        # cpu cycles spent around every transaction (chip select toggles
+        # and driver setup)
+        self.overhead = overhead
+        self.vcd = vcd
+
+        self.now = 0.0
+        self.transactions = 0
+        self.bytes = 0
+
+    def transfer(self, mosi):
+        """ Run a single transaction and return the data on miso """
+        self.now += (self.overhead * 1e6) / self.cpu_clock
+
+        miso = self.chip.transfer(self.now, self.clock, bytes(mosi))
+
+        if self.vcd:
+            self.vcd.transaction(self.now, self.clock, bytes(mosi), miso)
+
+        self.now += (len(mosi) * 8 * 1e6) / self.clock
+        self.transactions += 1
+        self.bytes += len(mosi)
+
+        return miso
+
+    def delay(self, duration):
+        """ Busy wait for a amount of microseconds """
+        self.now += duration
+
+
+def address_bytes(address):
+    return (address & 0xffffff).to_bytes(3, 'big')
+
+
+class Loader:
+    """
+    Model of the ramcode in flash/flash_device.cpp. The functions return
+    the same values as the ramcode functions.
+    """
+
+    POLL_INTERVAL = 3000
+
+    # erase granularities with the command and the operation name
+    ERASE = {
+        'sector': (0x1000, CMD_SECTOR_ERASE, 'sector_erase'),
+        'block_32k': (0x8000, CMD_BLOCK_ERASE_32K, 'block_erase_32k'),
+        'block_64k': (0x10000, CMD_BLOCK_ERASE_64K, 'block_erase_64k'),
+    }
+
+    def __init__(self, bus, timing=DATASHEET, read_size=0x2000, poll_interval=None, timeline=None, track_state=True):
+        self.bus = bus
+        self.timing = timing
+        self.read_size = read_size
+
+        # model of the chip state (flash/state.hpp). Skips the status 
+        # polls before the typical time of a operation and fails when the
+        # write enable latch is still set after it
+        self.track_state = track_state
+
+        # interval in microseconds between status polls. Init in the 
+        # ramcode shortens it to the typical page program time
+        if poll_interval is None:
+            poll_interval = min(self.POLL_INTERVAL, timing['page_program'][0])
+
+        self.poll_interval = poll_interval
+
+        # timeline of the ramcode calls and the bus operations inside
+        # them (timeline.Timeline). Same events as flash/trace.hpp
+        self.timeline = timeline
+
+    @contextlib.contextmanager
+    def span(self, name, category='bus'):
+        """ Add the code inside the context to the timeline """
+        if self.timeline:
+            self.timeline.begin(name, self.bus.now, category)
+
+        try:
+            yield
+        finally:
+            if self.timeline:
+                self.timeline.end(self.bus.now)
+
+    def write_enable(self):
+        with self.span('wren'):
+            self.bus.transfer([CMD_WRITE_ENABLE])
+
+    def is_busy(self):
+        return bool(self.bus.transfer([CMD_READ_STATUS, 0])[1] & STATUS_WIP)
+
+    def wait_ready(self, timeout, typical=0):
+        """
+        Wait until the chip is ready. With the state model the first poll
+        is done after the typical time of the operation that was started
+        """
+        waited = 0
+
+        with self.span('busy'):
+            if self.track_state:
+                # the ramcode yields in steps of the poll interval without
+                # touching the bus
+                while waited < typical:
+                    self.bus.delay(self.poll_interval)
+                    waited += self.poll_interval
+
+            while True:
+                status = self.bus.transfer([CMD_READ_STATUS, 0])[1]
+
+                if not status & STATUS_WIP:
+                    break
+
+                if waited >= timeout:
+                    return False
+
+                self.bus.delay(self.poll_interval)
+                waited += self.poll_interval
+
+        # the latch clears when the operation is done. When it is still
+        # set the chip ignored the command
+        return not (self.track_state and typical and (status & STATUS_WEL))
+
+    def read(self, address, size):
+        with self.span('read'):
+            return self.bus.transfer(
+                [CMD_READ] + list(address_bytes(address)) + [0] * size
+            )[4:]
+
+    READY_POLL_INTERVAL = 10
+
+    def jedec_id(self):
+        return int.from_bytes(self.bus.transfer([CMD_JEDEC_ID, 0, 0, 0])[1:], 'big')
+
+    def reset_continuous(self):
+        """ Clear the continuous read mode. Returns if the chip answers after it """
+        self.bus.transfer([0xff, 0xff])
+
+        return self.jedec_id() not in (0x000000, 0xffffff)
+
+    def init(self):
+        def valid(id):
+            return id not in (0x000000, 0xffffff)
+
+        with self.span('init', 'call'):
+            if not valid(self.jedec_id()) and not (self.track_state and self.reset_continuous()):
+                self.bus.transfer([CMD_RELEASE_POWER_DOWN])
+
+                start = self.bus.now
+                timeout = self.timing['power_up'][1] + self.timing['release_power_down'][1]
+
+                while not valid(self.jedec_id()):
+                    if (self.bus.now - start) >= timeout:
+                        return 2
+
+                    self.bus.delay(self.READY_POLL_INTERVAL)
+
+            return 0 if self.wait_ready(self.timing['chip_erase'][1]) else 1
+
+    def uninit(self):
+        with self.span('uninit', 'call'):
+            return 0
+
+    def erase_unit(self, address, granularity):
+        """ Erase a single erase unit (a single erase command) """
+        _, command, operation = self.ERASE[granularity]
+
+        self.write_enable()
+
+        with self.span('erase'):
+            self.bus.transfer([command] + list(address_bytes(address)))
+
+        return 0 if self.wait_ready(self.timing[operation][1], self.timing[operation][0]) else 1
+
+    def erase_sector(self, address, granularity='sector'):
+        with self.span('erase', 'call'):
+            return self.erase_unit(address, granularity)
+
+    def erase_chip(self):
+        with self.span('erase_chip', 'call'):
+            self.write_enable()
+
+            with self.span('erase'):
+                self.bus.transfer([CMD_CHIP_ERASE])
+
+            return 0 if self.wait_ready(self.timing['chip_erase'][1], self.timing['chip_erase'][0]) else 1
+
+    def program_page(self, address, data):
+        with self.span('program', 'call'):
+            self.write_enable()
+
+            with self.span('transfer'):
+                self.bus.transfer([CMD_PAGE_PROGRAM] + list(address_bytes(address)) + list(data))
+
+            return 0 if self.wait_ready(self.timing['page_program'][1], self.timing['page_program'][0]) else 1
+
+    def program(self, address, data):
+        for offset in range(0, len(data), Chip.PAGE_SIZE):
+            if self.program_page(address + offset, data[offset:offset + Chip.PAGE_SIZE]):
+                return 1
+
+        return 0
+
+    def erase(self, address, count, granularity='sector'):
+        size = self.ERASE[granularity][0]
+
+        for i in range(count):
+            if self.erase_sector(address + (i * size), granularity):
+                return 1
+
+        return 0
+
+    def plan(self, start, end):
+        """
+        Split a range in the largest erase units that are aligned and fit
+        (the erase planner). Returns a list of (offset, unit) or None when
+        the range is not aligned to the sectors
+        """
+        units = sorted(self.ERASE, key=lambda unit: self.ERASE[unit][0], reverse=True)
+        steps = []
+
+        while start < end:
+            for unit in units:
+                size = self.ERASE[unit][0]
+
+                if not (start & (size - 1)) and (start + size) <= end:
+                    break
+            else:
+                return None
+
+            steps.append((start, unit))
+            start += size
+
+        return steps
+
+    def erase_range(self, start, end):
+        """ Erase a range with the erase planner (SEGGER_OPEN_Erase) """
+        steps = self.plan(start, end)
+
+        with self.span('erase', 'call'):
+            if steps is None:
+                return 1
+
+            for offset, unit in steps:
+                if self.erase_unit(offset, unit):
+                    return 1
+
+        return 0
+
+    def read_range(self, address, size):
+        """ Read a range in chunks of the read buffer (SEGGER_OPEN_Read) """
+        data = bytearray()
+
+        for offset in range(0, size, self.read_size):
+            with self.span('read', 'call'):
+                data += self.read(address + offset, min(self.read_size, size - offset))
+
+        return bytes(data)
+
+    def crc(self, address, size):
+        """ Crc-32 of a range. Streamed in chunks like read_crc in the ramcode """
+        value = 0
+
+        for offset in range(0, size, 0x1000):
+            with self.span('crc'):
+                value = zlib.crc32(self.bus.transfer(
+                    [CMD_READ] + list(address_bytes(address + offset)) + [0] * min(0x1000, size - offset)
+                )[4:], value)
+
+        return value
+
+    def program_batch(self, regions, done=None):
+        """
+        Program a list of (address, data, critical) regions (ProgramBatch).
+        The erase is planned over all the regions at once. Every erase unit
+        is erased right before the first critical region in it, the other
+        units after all the critical regions are programmed and checked.
+        Calls done with the address of every region that is finished
+        """
+        # regions may share a sector but not a byte
+        for i, (a, data_a, _) in enumerate(regions):
+            for b, data_b, _ in regions[:i]:
+                if a < (b + len(data_b)) and b < (a + len(data_a)):
+                    return 1
+
+        spans = [(address & ~0xfff, (address + len(data) + 0xfff) & ~0xfff) for address, data, _ in regions]
+
+        # merge the regions that overlap or are next to each other
+        ranges = []
+
+        for start, end in sorted(spans):
+            if ranges and start <= ranges[-1][1]:
+                ranges[-1] = (ranges[-1][0], max(end, ranges[-1][1]))
+            else:
+                ranges.append((start, end))
+
+        # give every erase unit to the first critical region in it
+        owners = {}
+
+        for start, end in ranges:
+            for offset, unit in self.plan(start, end):
+                size = self.ERASE[unit][0]
+                owner = next((
+                    i for i, (s, e) in enumerate(spans)
+                    if regions[i][2] and s < (offset + size) and e > offset
+                ), None)
+
+                owners.setdefault(owner, []).append((offset, unit))
+
+        def erase(owner):
+            with self.span('erase', 'call'):
+                return any(self.erase_unit(offset, unit) for offset, unit in owners.get(owner, []))
+
+        with self.span('batch', 'call'):
+            for i, (address, data, critical) in enumerate(regions):
+                if not critical:
+                    continue
+
+                if erase(i) or self.program(address, data):
+                    return 1
+
+                if self.crc(address, len(data)) != zlib.crc32(data):
+                    return 2
+
+                if done:
+                    done(address)
+
+            if erase(None):
+                return 1
+
+            for address, data, critical in regions:
+                if critical:
+                    continue
+
+                if self.program(address, data):
+                    return 1
+
+                if done:
+                    done(address)
+
+        return 0
+
+    def blank_check(self, address, size, value=0xff):
+        with self.span('blank_check', 'call'):
+            for offset in range(0, size, self.read_size):
+                data = self.read(address + offset, min(self.read_size, size - offset))
+
+                with self.span('blank'):
+                    if any(byte != value for byte in data):
+                        return 1
+
+        return 0
+
+
+def session(loader, image, erase='sector'):
+    """
+    A J-Link flashing session of a image at the start of the device. Erases
+    with the granularity ('chip' for a chip erase, 'planned' for the erase
+    planner), programs and reads back the image for the verify. Returns the
+    result of the first step that failed or 0
+    """
+    def erase_step():
+        if erase == 'chip':
+            return loader.erase_chip()
+
+        if erase == 'planned':
+            return loader.erase_range(0, (len(image) + 0xfff) & ~0xfff)
+
+        size = Loader.ERASE[erase][0]
+
+        return loader.erase(0, (len(image) + size - 1) // size, erase)
+
+    steps = [
+        lambda: loader.init(),
+        erase_step,
+        lambda: loader.program(0, image),
+        lambda: 0 if loader.read_range(0, len(image)) == image else 1,
+        lambda: loader.uninit(),
+    ]
+
+    for step in steps:
+        result = step()
+
+        if result:
+            return result
+
+    return 0
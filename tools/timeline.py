@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""
+Convert the trace buffer of the loader (LoaderTrace, see flash/trace.hpp)
+to the chrome trace event format. Open the output in chrome://tracing or
+ui.perfetto.dev.
+
+Read the header and the ring with J-Link after the session. The header is
+at the LoaderTrace symbol of the loader. The ring is at the address in
+the last word of the header and is 8 bytes per entry (third word):
+
+    arm-none-eabi-nm flash_loader.elf | grep LoaderTrace
+    J-Link> savebin trace.bin <address> 0x14
+    J-Link> mem32 <address> 5
+    J-Link> savebin ring.bin <entries> <size * 8>
+
+A warning is shown when the ring overwrote entries before it was read. The
+timeline misses the start of the session in that case.
+
+usage:
+    timeline.py trace.bin ring.bin [--output trace.json] [--clock 96000000]
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+
+# marker of a initialized trace buffer
+MARKER = 0x54524345
+
+END_FLAG = 0x80000000
+
+# names of the progress operations. Used as the name of the call events
+OPERATIONS = [
+    'idle', 'init', 'erase', 'erase_chip', 'program', 'blank_check',
+    'read', 'hash', 'estimate', 'dump', 'extents', 'verify', 'crc',
+    'batch',
+]
+
+# names of the trace events
+EVENTS = ['call', 'transfer', 'erase', 'busy', 'read', 'blank', 'hash', 'crc']
+
+
+class Timeline:
+    """
+    Chrome trace events of a session. Events nest on a single thread. The
+    gaps between the outermost events are added as idle events when idle
+    is set. Only use it when the time between the events is known
+    """
+
+    def __init__(self, name='loader', idle=True):
+        self.events = [{'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': 0, 'args': {'name': name}}]
+        self.idle = idle
+        self.depth = 0
+        self.last = None
+
+    def begin(self, name, time, category='bus'):
+        """ Start a event at a time in microseconds """
+        if self.idle and not self.depth and self.last is not None and time > self.last:
+            self.events.append({
+                'name': 'idle', 'cat': 'idle', 'ph': 'X', 'pid': 0, 'tid': 0,
+                'ts': self.last, 'dur': time - self.last,
+            })
+
+        self.events.append({'name': name, 'cat': category, 'ph': 'B', 'pid': 0, 'tid': 0, 'ts': time})
+        self.depth += 1
+
+    def end(self, time):
+        """ End the last event that was started """
+        self.events.append({'ph': 'E', 'pid': 0, 'tid': 0, 'ts': time})
+        self.depth -= 1
+
+        if not self.depth:
+            self.last = time
+
+    def write(self, file, **other):
+        json.dump({'traceEvents': self.events, 'displayTimeUnit': 'ms', 'otherData': other}, file)
+
+
+def header(data):
+    """ Get the head, size and overwritten count of the trace buffer """
+    marker, head, size, overwritten = struct.unpack_from('<IIII', data, 0)
+
+    if marker != MARKER:
+        raise ValueError('trace buffer is not initialized')
+
+    return head, size, overwritten
+
+
+def entries(data, ring):
+    """ Get the entries from the oldest to the newest """
+    head, size, _ = header(data)
+
+    if len(ring) < (size * 8):
+        raise ValueError('ring has {} bytes, expected {}'.format(len(ring), size * 8))
+
+    start = max(0, head - size)
+
+    return [struct.unpack_from('<II', ring, (i % size) * 8) for i in range(start, head)]
+
+
+def convert(data, ring, clock):
+    """
+    Convert a trace buffer and its ring to a timeline. The cycle counter
+    stops while J-Link halts the core between the calls, so the time 
+    between the calls is not known. The calls are shown back to back 
+    without idle events
+    """
+    timeline = Timeline(idle=False)
+
+    # names of the events that are started
+    stack = []
+
+    # the cycle counter wraps. Every entry is assumed to be less than a
+    # full wrap after the previous entry
+    time = 0
+    previous = None
+
+    for timestamp, id in entries(data, ring):
+        if previous is not None:
+            time += (timestamp - previous) & 0xffffffff
+
+        previous = timestamp
+
+        event = EVENTS[(id >> 8) & 0x7f]
+        argument = id & 0xff
+        name = OPERATIONS[argument] if event == 'call' else event
+
+        if id & END_FLAG:
+            # skip the end of events that started before the oldest entry
+            if name in stack:
+                while stack.pop() != name:
+                    timeline.end((time * 1e6) / clock)
+
+                timeline.end((time * 1e6) / clock)
+        else:
+            stack.append(name)
+            timeline.begin(name, (time * 1e6) / clock, 'call' if event == 'call' else 'bus')
+
+    # close the events that did not end before the buffer was read
+    while stack:
+        stack.pop()
+        timeline.end((time * 1e6) / clock)
+
+    return timeline
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('buffer', help='trace buffer header read from the loader')
+    parser.add_argument('ring', help='trace ring read from the loader')
+    parser.add_argument('--output', default='trace.json', help='chrome trace output')
+    parser.add_argument('--clock', type=int, default=96_000_000, help='cpu clock of the loader')
+    args = parser.parse_args()
+
+    with open(args.buffer, 'rb') as file:
+        data = file.read()
+
+    with open(args.ring, 'rb') as file:
+        ring = file.read()
+
+    try:
+        _, _, overwritten = header(data)
+        timeline = convert(data, ring, args.clock)
+    except ValueError as error:
+        print('trace: {}'.format(error), file=sys.stderr)
+        return 1
+
+    # the events before the oldest entry are lost. The events that ended
+    # after it are closed without their start
+    if overwritten:
+        print('trace: {} entries were overwritten, the timeline misses the start of the session'.format(
+            overwritten
+        ), file=sys.stderr)
+
+    with open(args.output, 'w') as file:
+        timeline.write(file, overwritten=overwritten)
+
+    print('{} events written to {}'.format(len(timeline.events) - 1, args.output))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())